@@ -0,0 +1,182 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 指针所指向的对象：沿getelemptr/getptr找到最初的基地址
+// 结果可能是alloc、全局变量，或者是load出来的指针（数组参数）
+koopa_raw_value_t Mem_base(koopa_raw_value_t ptr)
+{
+    while (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ptr->kind.tag == KOOPA_RVT_GET_PTR)
+    {
+        if (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+            ptr = ptr->kind.data.get_elem_ptr.src;
+        else ptr = ptr->kind.data.get_ptr.src;
+    }
+    return ptr;
+}
+
+// 是否是一个确定的内存对象（局部或全局的alloc）
+static bool Is_object(koopa_raw_value_t base)
+{
+    return base->kind.tag == KOOPA_RVT_ALLOC || base->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+// SysY中只有数组的地址能被传给函数，标量变量的地址不会逃逸
+static bool Is_scalar_object(koopa_raw_value_t base)
+{
+    return Is_object(base) && base->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY;
+}
+
+// 地址计算中的一层：getelemptr或getptr及其下标
+struct Addr_step
+{
+    bool is_ptr; // getptr
+    koopa_raw_value_t index;
+    int stride; // 下标每增加1，地址增加的字节数
+};
+
+// 从基地址开始，逐层向内的地址计算
+static vector<Addr_step> Addr_steps(koopa_raw_value_t ptr)
+{
+    vector<Addr_step> steps;
+    while (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ptr->kind.tag == KOOPA_RVT_GET_PTR)
+    {
+        Addr_step step;
+        step.is_ptr = ptr->kind.tag == KOOPA_RVT_GET_PTR;
+        step.stride = Type_size(ptr->ty->data.pointer.base);
+        if (step.is_ptr)
+        {
+            step.index = ptr->kind.data.get_ptr.index;
+            ptr = ptr->kind.data.get_ptr.src;
+        }
+        else
+        {
+            step.index = ptr->kind.data.get_elem_ptr.index;
+            ptr = ptr->kind.data.get_elem_ptr.src;
+        }
+        steps.push_back(step);
+    }
+    reverse(steps.begin(), steps.end());
+    return steps;
+}
+
+static bool Same_index(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    if (Is_const(a) && Is_const(b))
+        return a->kind.data.integer.value == b->kind.data.integer.value;
+    return a == b;
+}
+
+// 基地址相同的两个指针的关系
+static Alias_result Alias_same_base(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    vector<Addr_step> sa = Addr_steps(a), sb = Addr_steps(b);
+
+    // 两条地址计算的形状相同时，同一层的getelemptr都是数组内层的下标，
+    // 下标合法时，某一层的常数下标不同就一定不重叠，例如a[i][0]与a[j][1]
+    // 形状不同时（例如展平后用getptr访问的数组初始化）同一层的下标没有可比性，只能比较字节偏移
+    bool same_shape = sa.size() == sb.size();
+    for (size_t i = 0; same_shape && i < sa.size(); i++)
+        same_shape = sa[i].is_ptr == sb[i].is_ptr && sa[i].stride == sb[i].stride;
+    if (same_shape)
+        for (size_t i = 0; i < sa.size(); i++)
+            if (!sa[i].is_ptr && Is_const(sa[i].index) && Is_const(sb[i].index) && !Same_index(sa[i].index, sb[i].index))
+                return NO_ALIAS;
+
+    // 把地址分解为常数偏移和变量部分，变量部分完全相同时比较两段内存的范围
+    int offset_a = 0, offset_b = 0;
+    vector<pair<koopa_raw_value_t, int>> terms_a, terms_b;
+    for (auto &step : sa)
+    {
+        if (Is_const(step.index))
+            offset_a += step.index->kind.data.integer.value * step.stride;
+        else terms_a.push_back(make_pair(step.index, step.stride));
+    }
+    for (auto &step : sb)
+    {
+        if (Is_const(step.index))
+            offset_b += step.index->kind.data.integer.value * step.stride;
+        else terms_b.push_back(make_pair(step.index, step.stride));
+    }
+    if (terms_a != terms_b)
+        return MAY_ALIAS;
+
+    int size_a = Type_size(a->ty->data.pointer.base), size_b = Type_size(b->ty->data.pointer.base);
+    if (offset_a + size_a <= offset_b || offset_b + size_b <= offset_a)
+        return NO_ALIAS;
+    if (offset_a == offset_b && size_a == size_b)
+        return MUST_ALIAS;
+    return MAY_ALIAS;
+}
+
+// 两个指针指向的内存是否可能重叠
+// 不同的对象互不重叠；数组参数可能指向任何数组，但不会指向标量；
+// 同一基地址出发的地址按下标比较，要求每一层数组的下标都在范围内
+Alias_result Alias(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    koopa_raw_value_t base_a = Mem_base(a), base_b = Mem_base(b);
+    if (base_a == base_b)
+        return Alias_same_base(a, b);
+    if (Is_object(base_a) && Is_object(base_b))
+        return NO_ALIAS;
+    if (Is_scalar_object(base_a) || Is_scalar_object(base_b))
+        return NO_ALIAS;
+    return MAY_ALIAS;
+}
+
+// 指针base是否可能指向arg_base出发的内存（或反过来）
+// 数组参数只可能指向调用者的数组或全局数组，不会指向本函数的局部数组
+static bool May_point_to(koopa_raw_value_t base, koopa_raw_value_t arg_base)
+{
+    if (base == arg_base)
+        return true;
+    if (Is_object(base) && Is_object(arg_base))
+        return false;
+    koopa_raw_value_t object = Is_object(base) ? base : arg_base;
+    return !Is_object(object) || object->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+// 函数调用是否可能读写ptr指向的内存
+// 有函数体的函数可以访问所有全局变量和传入的数组；库函数只会访问通过参数传入的数组
+bool Call_may_access(koopa_raw_value_t call, koopa_raw_value_t ptr)
+{
+    koopa_raw_value_t base = Mem_base(ptr);
+    bool is_decl = call->kind.data.call.callee->bbs.len == 0;
+    if (!is_decl && base->kind.tag != KOOPA_RVT_ALLOC)
+        return true;
+    if (Is_scalar_object(base))
+        return false;
+
+    auto &args = call->kind.data.call.args;
+    for (size_t i = 0; i < args.len; i++)
+    {
+        koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        if (arg->ty->tag == KOOPA_RTT_POINTER && May_point_to(base, Mem_base(arg)))
+            return true;
+    }
+    return false;
+}
+
+// 只通过load/store直接访问的局部标量变量，它们在函数返回后就不再存在
+vector<koopa_raw_value_t> Local_scalars(Func_IR *func)
+{
+    set<koopa_raw_value_t> bad;
+    vector<koopa_raw_value_t> vars;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC && inst->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY)
+                vars.push_back(inst);
+            for (auto op : Operands(inst))
+            {
+                bool direct = (inst->kind.tag == KOOPA_RVT_LOAD) || (inst->kind.tag == KOOPA_RVT_STORE && op == &Mut(inst)->kind.data.store.dest);
+                if (!direct)
+                    bad.insert(*op);
+            }
+        }
+
+    vector<koopa_raw_value_t> result;
+    for (auto var : vars)
+        if (!bad.count(var))
+            result.push_back(var);
+    return result;
+}
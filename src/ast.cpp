@@ -1,4 +1,5 @@
 #include "inc/ast.hpp"
+#include "inc/opt.hpp"
 
 ST_stack sym_table; // 符号表
 bool ret = false; // 是否遇到return
@@ -9,6 +10,9 @@ stack<int> while_stack; // 用一个栈来储存while循环的层次
 int while_remain_num; // 被break或continue截断的while循环中剩余部分，编号
 int tmp_addr;
 int tmp_reg;
+string reg_prefix; // 输出寄存器时附加的前缀，用于重复输出同一个表达式
+string const_arr_defs; // 局部常量数组作为全局变量的定义
+bool fill_words_used; // 局部数组的初始化是否调用了__fill_words
 
 // 变量ident在ir中的新名字。num是其所在符号表的编号
 string Var_name(string ident, int num)
@@ -47,7 +51,7 @@ string Ptr_name(string ident, int num)
 }
 
 // @arr = alloc [[i32, 3], 2]
-void Arrange_alloc(vector<int> dims, ostream &os)
+void Arrange_alloc(const vector<int> &dims, ostream &os)
 {
     // os << "alloc ";
     for (int i = 0; i < dims.size(); i++)
@@ -58,17 +62,28 @@ void Arrange_alloc(vector<int> dims, ostream &os)
 }
 
 // 将数组的初始化列表整理成标准形式输出
-void Arrange_init_list(vector<Register> regs_list, int begin, int end, vector<int> dims, ostream &os)
+// [begin, end)是展开后的初始值中对应子数组dims[depth..]的部分
+void Arrange_init_list(const vector<Register> &regs_list, int begin, int end, const vector<int> &dims, int depth, ostream &os)
 {
     int prod = 1;
-    for (int i = 0; i < dims.size(); i++)
+    for (int i = depth; i < dims.size(); i++)
         prod *= dims[i];
 
     assert(prod == end - begin);
 
+    // 全0的部分直接输出zeroinit
+    bool all_zero = true;
+    for (int i = begin; i < end && all_zero; i++)
+        all_zero = !regs_list[i].is_var && regs_list[i].value == 0;
+    if (all_zero)
+    {
+        os << "zeroinit";
+        return;
+    }
+
     os << "{";
     // 一维数组，直接输出元素
-    if (dims.size() == 1) 
+    if (depth == dims.size() - 1) 
     {
         for (int i = begin; i < end; i++)
         {
@@ -80,22 +95,60 @@ void Arrange_init_list(vector<Register> regs_list, int begin, int end, vector<in
     // 高维数组，递归处理
     else 
     {
-        vector<int> tmp_dims;
-        for (int i = 1; i < dims.size(); i++)
-            tmp_dims.push_back(dims[i]);
-        
-        for (int i = begin; i < end; i += (prod / dims[0]))
+        int step = prod / dims[depth];
+        for (int i = begin; i < end; i += step)
         {
             if (i != begin) os << ", ";
-            Arrange_init_list(regs_list, i, i + prod / dims[0], tmp_dims, os);
+            Arrange_init_list(regs_list, i, i + step, dims, depth + 1, os);
         }
             
     }
     os << "}";
 }
 
+// 展开初始化列表{init_lists}，它对应的子数组维数为dims[depth..]
+// 每个元素按当前已展开的长度决定在哪一维对齐，结果直接写入buf，不产生中间的vector
+void Flatten_init(const vector<unique_ptr<BaseAST>> &init_lists, const vector<int> &dims, int depth, vector<Register> &buf)
+{
+    assert(depth < dims.size());
+    int start = buf.size();
+    for (int i = 0; i < init_lists.size(); i++)
+    {
+        // 根据已展开的长度确定在哪一维处对齐
+        int s = buf.size() - start;
+        int j;
+        for (j = dims.size() - 1; j >= depth; j--)
+        {
+            if (s % dims[j] != 0)
+                break;
+            s = s / dims[j];
+        }
+        init_lists[i]->Flatten_list(dims, max(depth + 1, j + 1), buf);
+    }
+
+    // 补0
+    int prod = 1; // 子数组的期望长度
+    for (int i = depth; i < dims.size(); i++)
+        prod *= dims[i];
+    if (buf.size() < start + prod)
+        buf.resize(start + prod, Register(0, 0, false));
+}
+
+// 展开整个数组的初始化列表
+vector<Register> Flatten_arr(BaseAST *init_list, const vector<int> &dims)
+{
+    int prod = 1;
+    for (int i = 0; i < dims.size(); i++)
+        prod *= dims[i];
+
+    vector<Register> regs_list;
+    regs_list.reserve(prod);
+    init_list->Flatten_list(dims, 0, regs_list);
+    return regs_list;
+}
+
 // 局部数组初始赋值
-void Store_arr(vector<Register> regs_list, vector<int> dims, int depth, string base, ostream &os)
+void Store_arr(const vector<Register> &regs_list, const vector<int> &dims, int depth, const string &base, ostream &os)
 {
     if (depth == dims.size())
     {
@@ -110,4 +163,44 @@ void Store_arr(vector<Register> regs_list, vector<int> dims, int depth, string b
         Store_arr(regs_list, dims, depth + 1, new_base, os);
     }
     
-}
\ No newline at end of file
+}
+
+#define ZERO_FILL_MIN 16 // 局部数组初始值中0的个数达到该值时，先用__fill_words清零整个数组
+
+// 局部数组初始化
+// 初始值中0较多时，先调用__fill_words把整个数组清零，再只对非0元素store，避免每个元素都输出一条store
+// __fill_words由后端输出，输出Koopa IR时仍然逐个元素store，保证IR可以单独链接运行
+void Init_arr(const vector<Register> &regs_list, const vector<int> &dims, const string &base, ostream &os)
+{
+    int zeros = 0;
+    for (int i = 0; i < regs_list.size(); i++)
+        if (!regs_list[i].is_var && regs_list[i].value == 0)
+            zeros++;
+
+    if (zeros < ZERO_FILL_MIN || !opt_options.riscv_target)
+    {
+        tmp_reg = 0;
+        Store_arr(regs_list, dims, 0, base, os);
+        return;
+    }
+
+    // 指向第一个元素的*i32，之后把数组当作一维的用getptr访问
+    string flat = base;
+    for (int i = 0; i < dims.size(); i++)
+    {
+        string next = "%addr" + to_string(tmp_addr++);
+        os << next << " = getelemptr " << flat << ", 0" << endl;
+        flat = next;
+    }
+    fill_words_used = true;
+    os << "call @__fill_words(" << flat << ", 0, " << regs_list.size() << ")" << endl;
+
+    for (int i = 0; i < regs_list.size(); i++)
+    {
+        if (!regs_list[i].is_var && regs_list[i].value == 0)
+            continue;
+        string elem = "%addr" + to_string(tmp_addr++);
+        os << elem << " = getptr " << flat << ", " << i << endl;
+        os << "store " << regs_list[i] << ", " << elem << endl;
+    }
+}
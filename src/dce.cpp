@@ -0,0 +1,120 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 条件为常数的br改为jump
+static bool Fold_branches(Func_IR *func)
+{
+    bool changed = false;
+    for (Block_IR *block : func->blocks)
+    {
+        koopa_raw_value_t term = block->Terminator();
+        if (term->kind.tag != KOOPA_RVT_BRANCH || !Is_const(term->kind.data.branch.cond))
+            continue;
+        auto &branch = term->kind.data.branch;
+        Block_IR *target = func->block_map[branch.cond->kind.data.integer.value != 0 ? branch.true_bb : branch.false_bb];
+        block->insts.back() = New_jump(target);
+        changed = true;
+    }
+    return changed;
+}
+
+// 删除从入口不可达的块，例如break、continue、return之后的while_remain
+static bool Remove_unreachable(Func_IR *func)
+{
+    size_t size = func->blocks.size();
+    func->blocks.erase(remove_if(func->blocks.begin() + 1, func->blocks.end(), [](Block_IR *block) {
+        return block->rpo < 0;
+    }), func->blocks.end());
+    return func->blocks.size() != size;
+}
+
+// 合并基本块：A以jump B结尾，且B只有A一个前驱时，把B接到A的后面
+static bool Merge_blocks(Func_IR *func)
+{
+    bool changed = false;
+    set<Block_IR *> removed;
+    for (Block_IR *block : func->blocks)
+    {
+        if (removed.count(block))
+            continue;
+        while (true)
+        {
+            koopa_raw_value_t term = block->Terminator();
+            if (term->kind.tag != KOOPA_RVT_JUMP)
+                break;
+            Block_IR *succ = func->block_map[term->kind.data.jump.target];
+            if (succ == block || succ == func->blocks[0] || succ->preds.size() != 1)
+                break;
+
+            block->insts.pop_back();
+            block->insts.insert(block->insts.end(), succ->insts.begin(), succ->insts.end());
+            block->succs = succ->succs;
+            for (Block_IR *next : succ->succs)
+                replace(next->preds.begin(), next->preds.end(), succ, block);
+            removed.insert(succ);
+            changed = true;
+        }
+    }
+    func->blocks.erase(remove_if(func->blocks.begin(), func->blocks.end(), [&](Block_IR *block) {
+        return removed.count(block) != 0;
+    }), func->blocks.end());
+    return changed;
+}
+
+// 删除只被写入、从未被读取的局部变量以及对它们的store
+static bool Remove_dead_allocs(Func_IR *func)
+{
+    set<koopa_raw_value_t> read; // 除了作为store的目标之外还有其他使用的值
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            for (auto op : Operands(inst))
+                if (!(inst->kind.tag == KOOPA_RVT_STORE && op == &Mut(inst)->kind.data.store.dest))
+                    read.insert(*op);
+
+    set<koopa_raw_value_t> dead;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            if (inst->kind.tag == KOOPA_RVT_ALLOC && !read.count(inst))
+                dead.insert(inst);
+    if (dead.empty())
+        return false;
+
+    for (Block_IR *block : func->blocks)
+    {
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            if (dead.count(inst))
+                continue;
+            if (inst->kind.tag == KOOPA_RVT_STORE && dead.count(inst->kind.data.store.dest))
+                continue;
+            remain.push_back(inst);
+        }
+        block->insts = remain;
+    }
+    return true;
+}
+
+// 死代码删除（dead code elimination）
+// 删除不可达的块、结果未被使用的无副作用指令和只写不读的局部变量，并合并可以合并的基本块
+void Dce(Func_IR *func)
+{
+    if (func->Is_decl())
+        return;
+
+    bool changed = true;
+    while (changed)
+    {
+        Build_CFG(func);
+        changed = Fold_branches(func);
+        if (changed)
+            Build_CFG(func);
+        changed = Remove_unreachable(func) || changed;
+        if (changed)
+            Build_CFG(func);
+        changed = Merge_blocks(func) || changed;
+        changed = Remove_dead_allocs(func) || changed;
+        changed = Remove_unused(func) || changed;
+    }
+    Build_CFG(func);
+}
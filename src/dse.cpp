@@ -0,0 +1,213 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 是否是对填充数组的例程__fill_words的调用
+static bool Is_fill(koopa_raw_value_t inst)
+{
+    if (inst->kind.tag != KOOPA_RVT_CALL)
+        return false;
+    koopa_raw_function_t callee = inst->kind.data.call.callee;
+    return callee->bbs.len == 0 && string(callee->name) == "@__fill_words";
+}
+
+// 用内存位置的活跃性删除局部标量的死store：store之后在到达下一次store或函数返回之前都不会再被读取
+static bool Remove_dead_scalar_stores(Func_IR *func)
+{
+    vector<koopa_raw_value_t> vars = Local_scalars(func);
+    if (vars.empty())
+        return false;
+    map<koopa_raw_value_t, int> index;
+    for (size_t i = 0; i < vars.size(); i++)
+        index[vars[i]] = i;
+
+    // 每个块的use（块中先于store被读取）、def（块中被store）集合
+    size_t n = vars.size();
+    map<Block_IR *, vector<bool>> use, def, live_in, live_out;
+    for (Block_IR *block : func->blocks)
+    {
+        vector<bool> &u = use[block], &d = def[block];
+        u.assign(n, false);
+        d.assign(n, false);
+        live_in[block].assign(n, false);
+        live_out[block].assign(n, false);
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_LOAD && index.count(inst->kind.data.load.src))
+            {
+                int k = index[inst->kind.data.load.src];
+                if (!d[k])
+                    u[k] = true;
+            }
+            else if (inst->kind.tag == KOOPA_RVT_STORE && index.count(inst->kind.data.store.dest))
+                d[index[inst->kind.data.store.dest]] = true;
+        }
+    }
+
+    // 逆向数据流，按逆后序的反序迭代到不动点
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = func->rpo_order.rbegin(); it != func->rpo_order.rend(); ++it)
+        {
+            Block_IR *block = *it;
+            vector<bool> out(n, false);
+            for (Block_IR *succ : block->succs)
+                for (size_t k = 0; k < n; k++)
+                    out[k] = out[k] || live_in[succ][k];
+            vector<bool> in(n);
+            for (size_t k = 0; k < n; k++)
+                in[k] = use[block][k] || (out[k] && !def[block][k]);
+            if (in != live_in[block])
+            {
+                live_in[block] = in;
+                changed = true;
+            }
+            live_out[block] = out;
+        }
+    }
+
+    bool removed = false;
+    for (Block_IR *block : func->rpo_order)
+    {
+        vector<bool> live = live_out[block];
+        vector<koopa_raw_value_t> remain;
+        for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it)
+        {
+            koopa_raw_value_t inst = *it;
+            if (inst->kind.tag == KOOPA_RVT_LOAD && index.count(inst->kind.data.load.src))
+                live[index[inst->kind.data.load.src]] = true;
+            else if (inst->kind.tag == KOOPA_RVT_STORE && index.count(inst->kind.data.store.dest))
+            {
+                int k = index[inst->kind.data.store.dest];
+                if (!live[k])
+                {
+                    removed = true;
+                    continue;
+                }
+                live[k] = false;
+            }
+            remain.push_back(inst);
+        }
+        reverse(remain.begin(), remain.end());
+        block->insts = remain;
+    }
+    return removed;
+}
+
+// 块内被覆盖的store：之后同一个块中又写入了同一位置，且中间没有可能读取它的load或函数调用
+static bool Remove_overwritten_stores(Func_IR *func)
+{
+    bool removed = false;
+    for (Block_IR *block : func->blocks)
+    {
+        vector<koopa_raw_value_t> later; // 之后一定会被覆盖的位置
+        vector<koopa_raw_value_t> remain;
+        for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it)
+        {
+            koopa_raw_value_t inst = *it;
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                koopa_raw_value_t dest = inst->kind.data.store.dest;
+                bool dead = false;
+                for (auto ptr : later)
+                    if (Alias(ptr, dest) == MUST_ALIAS)
+                        dead = true;
+                if (dead)
+                {
+                    removed = true;
+                    continue;
+                }
+                later.push_back(dest);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_LOAD)
+            {
+                koopa_raw_value_t src = inst->kind.data.load.src;
+                later.erase(remove_if(later.begin(), later.end(), [&](koopa_raw_value_t ptr) {
+                    return Alias(ptr, src) != NO_ALIAS;
+                }), later.end());
+            }
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                later.erase(remove_if(later.begin(), later.end(), [&](koopa_raw_value_t ptr) {
+                    return Call_may_access(inst, ptr);
+                }), later.end());
+            }
+            remain.push_back(inst);
+        }
+        reverse(remain.begin(), remain.end());
+        block->insts = remain;
+    }
+    return removed;
+}
+
+// 只被写入、从未被读取的局部数组：删除对它的所有store和__fill_words
+// 数组的地址传给其他函数（__fill_words除外）就可能被读取
+static bool Remove_unread_arrays(Func_IR *func)
+{
+    set<koopa_raw_value_t> arrays, read;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC && inst->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+                arrays.insert(inst);
+            if (inst->kind.tag == KOOPA_RVT_GET_ELEM_PTR || inst->kind.tag == KOOPA_RVT_GET_PTR)
+                continue;
+            auto ops = Operands(inst);
+            for (size_t i = 0; i < ops.size(); i++)
+            {
+                koopa_raw_value_t op = *ops[i];
+                if (op->ty->tag != KOOPA_RTT_POINTER)
+                    continue;
+                bool write = (inst->kind.tag == KOOPA_RVT_STORE && ops[i] == &Mut(inst)->kind.data.store.dest) || (Is_fill(inst) && i == 0);
+                if (!write)
+                    read.insert(Mem_base(op));
+            }
+        }
+
+    set<koopa_raw_value_t> dead;
+    for (auto array : arrays)
+        if (!read.count(array))
+            dead.insert(array);
+    if (dead.empty())
+        return false;
+
+    bool removed = false;
+    for (Block_IR *block : func->blocks)
+    {
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            koopa_raw_value_t dest = nullptr;
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+                dest = inst->kind.data.store.dest;
+            else if (Is_fill(inst))
+                dest = reinterpret_cast<koopa_raw_value_t>(inst->kind.data.call.args.buffer[0]);
+            if (dest != nullptr && dead.count(Mem_base(dest)))
+            {
+                removed = true;
+                continue;
+            }
+            remain.push_back(inst);
+        }
+        block->insts = remain;
+    }
+    return removed;
+}
+
+// 死store删除（dead store elimination）
+// 局部标量用逆向的活跃性分析，store之后的所有路径上都在读取之前被覆盖或函数返回时删除；
+// 其他内存位置只删除同一个块中被覆盖的store；从未被读取的局部数组删除所有写入
+// 删除store后不再使用的值和局部变量由之后的DCE清除
+void Dead_store_elim(Func_IR *func)
+{
+    if (func->Is_decl())
+        return;
+    Build_CFG(func);
+
+    bool removed = Remove_dead_scalar_stores(func);
+    removed = Remove_overwritten_stores(func) || removed;
+    removed = Remove_unread_arrays(func) || removed;
+    if (removed)
+        Remove_unused(func);
+}
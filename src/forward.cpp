@@ -0,0 +1,115 @@
+#include "inc/opt.hpp"
+
+#define MAX_AVAILABLE 128 // 同时记录的内存位置数上限，避免很大的块中查询过慢
+
+// 已知内容的内存位置：ptr指向的内存中当前的值为value
+struct Available
+{
+    koopa_raw_value_t ptr;
+    koopa_raw_value_t value;
+};
+
+// 删除可能被写入ptr指向内存的操作改变的记录
+static void Kill(vector<Available> &avail, koopa_raw_value_t ptr)
+{
+    vector<Available> remain;
+    for (auto &item : avail)
+        if (Alias(item.ptr, ptr) == NO_ALIAS)
+            remain.push_back(item);
+    avail = remain;
+}
+
+static void Kill_call(vector<Available> &avail, koopa_raw_value_t call)
+{
+    vector<Available> remain;
+    for (auto &item : avail)
+        if (!Call_may_access(call, item.ptr))
+            remain.push_back(item);
+    avail = remain;
+}
+
+static void Add(vector<Available> &avail, koopa_raw_value_t ptr, koopa_raw_value_t value)
+{
+    if (avail.size() >= MAX_AVAILABLE)
+        avail.erase(avail.begin());
+    Available item;
+    item.ptr = ptr;
+    item.value = value;
+    avail.push_back(item);
+}
+
+static koopa_raw_value_t Resolve(const map<koopa_raw_value_t, koopa_raw_value_t> &replace, koopa_raw_value_t value)
+{
+    auto it = replace.find(value);
+    while (it != replace.end())
+    {
+        value = it->second;
+        it = replace.find(value);
+    }
+    return value;
+}
+
+// 冗余load删除与store到load的转发（redundant load elimination / store-to-load forwarding）
+// 按逆后序遍历基本块，记录每个内存位置中已知的值：load的结果和store写入的值。
+// 再次读取一定相同的位置、且中间没有可能重叠的store或可能访问它的调用时，直接使用已知的值。
+// 只有一个前驱的块继承前驱结束时的记录，所以if/else的分支中也能使用条件判断之前读出的值
+void Forward_loads(Func_IR *func)
+{
+    if (func->Is_decl())
+        return;
+    Build_CFG(func);
+
+    map<Block_IR *, vector<Available>> out;
+    map<koopa_raw_value_t, koopa_raw_value_t> replace;
+    for (Block_IR *block : func->rpo_order)
+    {
+        vector<Available> avail;
+        if (block->preds.size() == 1 && out.count(block->preds[0]))
+            avail = out[block->preds[0]];
+
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            // 先把操作数换成替换后的值，这样相同的地址计算才能被识别为同一位置
+            for (auto op : Operands(inst))
+                *op = Resolve(replace, *op);
+
+            if (inst->kind.tag == KOOPA_RVT_LOAD)
+            {
+                koopa_raw_value_t src = inst->kind.data.load.src;
+                koopa_raw_value_t known = nullptr;
+                for (auto &item : avail)
+                    if (Alias(item.ptr, src) == MUST_ALIAS && item.value->ty->tag == inst->ty->tag)
+                        known = item.value;
+                if (known != nullptr)
+                {
+                    replace[inst] = known;
+                    continue;
+                }
+                Add(avail, src, inst);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                // 后端直接从a0-a7读取参数，参数只能在调用其他函数之前使用，所以不转发参数
+                koopa_raw_value_t value = inst->kind.data.store.value;
+                Kill(avail, inst->kind.data.store.dest);
+                if (value->kind.tag != KOOPA_RVT_FUNC_ARG_REF)
+                    Add(avail, inst->kind.data.store.dest, value);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+                Kill_call(avail, inst);
+            remain.push_back(inst);
+        }
+        block->insts = remain;
+        out[block] = avail;
+    }
+
+    if (replace.empty())
+        return;
+    // 在其他块中的使用
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            for (auto op : Operands(inst))
+                *op = Resolve(replace, *op);
+    Remove_unused(func);
+}
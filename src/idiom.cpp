@@ -0,0 +1,274 @@
+#include "inc/opt.hpp"
+
+#define IDIOM_MIN_TRIP 4 // 迭代次数已知且少于该值时，调用例程的开销超过循环本身
+
+// 填充或复制数组的循环：只有一个块，每次迭代执行 dest(i) = value 或 dest(i) = *src(i)
+struct Idiom_loop
+{
+    Loop *loop;
+    Counted_loop info;
+    koopa_raw_value_t store; // 对数组元素的store
+    koopa_raw_value_t src; // 复制时读取的地址，填充时为nullptr
+};
+
+static bool Defined_in(Func_IR *func, Loop *loop, koopa_raw_value_t value)
+{
+    auto it = func->def_block.find(value);
+    return it != func->def_block.end() && loop->Contains(it->second);
+}
+
+static bool Is_load_of(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    return value->kind.tag == KOOPA_RVT_LOAD && value->kind.data.load.src == var;
+}
+
+// 表达式中是否用到了var的值
+static bool Uses_var(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    if (Is_load_of(value, var))
+        return true;
+    for (auto op : Operands(value))
+        if (Uses_var(*op, var))
+            return true;
+    return false;
+}
+
+// 地址是否形如 base[i + k]：base和k都与i无关，相邻两次迭代访问相邻的int
+bool Is_unit_stride(koopa_raw_value_t addr, koopa_raw_value_t var)
+{
+    if (addr->ty->data.pointer.base->tag != KOOPA_RTT_INT32)
+        return false;
+    koopa_raw_value_t base, index;
+    if (addr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+        base = addr->kind.data.get_elem_ptr.src, index = addr->kind.data.get_elem_ptr.index;
+    else if (addr->kind.tag == KOOPA_RVT_GET_PTR)
+        base = addr->kind.data.get_ptr.src, index = addr->kind.data.get_ptr.index;
+    else return false;
+    if (Uses_var(base, var))
+        return false;
+    if (Is_load_of(index, var))
+        return true;
+    if (index->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    auto &bin = index->kind.data.binary;
+    if (bin.op == KOOPA_RBO_ADD)
+        return (Is_load_of(bin.lhs, var) && !Uses_var(bin.rhs, var)) || (Is_load_of(bin.rhs, var) && !Uses_var(bin.lhs, var));
+    if (bin.op == KOOPA_RBO_SUB)
+        return Is_load_of(bin.lhs, var) && !Uses_var(bin.rhs, var);
+    return false;
+}
+
+// 只有一个块的计数循环中，除了循环控制只有一条store（在i的更新之前），其余指令都没有副作用
+// loads中是除了对i的load以外的所有load。i的更新之后读到的是下一次迭代的值，只能用于latch中的比较
+bool Scan_single_store(Loop *loop, const Counted_loop &info, koopa_raw_value_t &store, vector<koopa_raw_value_t> &loads)
+{
+    bool updated = false;
+    store = nullptr;
+    for (auto inst : loop->header->insts)
+        switch (inst->kind.tag)
+        {
+        case KOOPA_RVT_LOAD:
+            if (Is_load_of(inst, info.var))
+            {
+                if (updated && inst != info.cond->kind.data.binary.lhs && inst != info.cond->kind.data.binary.rhs)
+                    return false;
+            }
+            else loads.push_back(inst);
+            break;
+        case KOOPA_RVT_STORE:
+            if (inst == info.store)
+                updated = true;
+            else if (store == nullptr && !updated)
+                store = inst;
+            else return false;
+            break;
+        case KOOPA_RVT_BINARY:
+        case KOOPA_RVT_GET_ELEM_PTR:
+        case KOOPA_RVT_GET_PTR:
+        case KOOPA_RVT_BRANCH:
+            break;
+        default:
+            return false;
+        }
+    return store != nullptr;
+}
+
+// 识别只有一个块、步长为1、递增的计数循环，块中除了循环控制只有一条对数组元素的store，
+// 存入的是在循环外计算的值或另一个数组对应位置的元素；其他load只能读取循环中不会被修改的标量
+static bool Analyze_idiom(Func_IR *func, Loop *loop, Idiom_loop &idiom)
+{
+    if (!loop->children.empty() || loop->blocks.size() != 1)
+        return false;
+    Counted_loop &info = idiom.info;
+    if (!Analyze_loop(func, loop, info) || info.step != 1 || (info.op != KOOPA_RBO_LT && info.op != KOOPA_RBO_LE))
+        return false;
+    idiom.loop = loop;
+    idiom.src = nullptr;
+
+    vector<koopa_raw_value_t> loads;
+    if (!Scan_single_store(loop, info, idiom.store, loads))
+        return false;
+
+    koopa_raw_value_t dest = idiom.store->kind.data.store.dest;
+    koopa_raw_value_t value = idiom.store->kind.data.store.value;
+    if (!Is_unit_stride(dest, info.var))
+        return false;
+    if (value->kind.tag == KOOPA_RVT_LOAD && Defined_in(func, loop, value))
+    {
+        // __copy_words要求两段内存不重叠：只复制两个不同数组之间的元素
+        idiom.src = value->kind.data.load.src;
+        if (!Is_unit_stride(idiom.src, info.var) || Mem_base(idiom.src) == Mem_base(dest) || Alias(idiom.src, dest) != NO_ALIAS)
+            return false;
+    }
+    else if (Defined_in(func, loop, value))
+        return false;
+
+    for (auto load : loads)
+    {
+        if (load == value)
+            continue;
+        koopa_raw_value_t ptr = load->kind.data.load.src;
+        if (Uses_var(ptr, info.var) || Alias(ptr, dest) != NO_ALIAS)
+            return false;
+    }
+
+    // 初值和边界都是常数时，迭代次数太少就不替换
+    int init;
+    Insert_preheader(func, loop);
+    if (Is_const(info.bound) && Find_init(loop, info.var, init))
+    {
+        long long count = (long long)info.bound->kind.data.integer.value - init + (info.op == KOOPA_RBO_LE);
+        if (count < IDIOM_MIN_TRIP)
+            return false;
+    }
+    return true;
+}
+
+// 在preheader中重新计算循环中的表达式在第一次迭代时的值：i替换为进入循环时的值first
+koopa_raw_value_t Rebuild_at_entry(Func_IR *func, Loop *loop, koopa_raw_value_t var, koopa_raw_value_t value, koopa_raw_value_t first,
+                                   vector<koopa_raw_value_t> &insts)
+{
+    if (!Defined_in(func, loop, value))
+        return value;
+    if (Is_load_of(value, var))
+        return first;
+    koopa_raw_value_t clone = Clone_inst(value);
+    for (auto op : Operands(clone))
+        *op = Rebuild_at_entry(func, loop, var, *op, first, insts);
+    insts.push_back(clone);
+    return clone;
+}
+
+// 循环的第一次迭代之前没有判断条件，所以至少执行一次：count = max(1, bound - first (+ 1))
+koopa_raw_value_t Emit_trip_count(const Counted_loop &info, koopa_raw_value_t first, vector<koopa_raw_value_t> &insts)
+{
+    koopa_raw_value_t diff = New_binary(KOOPA_RBO_SUB, info.bound, first);
+    insts.push_back(diff);
+    if (info.op == KOOPA_RBO_LE)
+        insts.push_back(diff = New_binary(KOOPA_RBO_ADD, diff, New_integer(1)));
+    koopa_raw_value_t positive = New_binary(KOOPA_RBO_GT, diff, New_integer(0));
+    koopa_raw_value_t minus_one = New_binary(KOOPA_RBO_SUB, diff, New_integer(1));
+    koopa_raw_value_t extra = New_binary(KOOPA_RBO_MUL, positive, minus_one);
+    koopa_raw_value_t count = New_binary(KOOPA_RBO_ADD, extra, New_integer(1));
+    insts.insert(insts.end(), {positive, minus_one, extra, count});
+    return count;
+}
+
+// 用preheader中的insts代替整个循环，然后把i设为循环结束时的值first + count
+void Replace_loop(Func_IR *func, Loop *loop, const Counted_loop &info, koopa_raw_value_t first, koopa_raw_value_t count,
+                  vector<koopa_raw_value_t> &insts)
+{
+    koopa_raw_value_t last = New_binary(KOOPA_RBO_ADD, first, count);
+    insts.push_back(last);
+    insts.push_back(New_store(last, info.var));
+    insts.push_back(New_jump(info.exit));
+
+    Block_IR *preheader = loop->preheader;
+    preheader->insts.pop_back();
+    preheader->insts.insert(preheader->insts.end(), insts.begin(), insts.end());
+
+    vector<Block_IR *> blocks;
+    for (Block_IR *block : func->blocks)
+        if (!loop->Contains(block))
+            blocks.push_back(block);
+    func->blocks = blocks;
+}
+
+static koopa_raw_function_t Find_decl(Program_IR *prog, string name)
+{
+    for (Func_IR *func : prog->funcs)
+        if (func->Is_decl() && string(func->func->name) == name)
+            return func->func;
+    return nullptr;
+}
+
+// 后端输出的例程（riscv.cpp）的声明，第一次使用时加入程序。params中p表示*i32，i表示i32
+koopa_raw_function_t Routine_decl(Program_IR *prog, const char *name, const char *params, bool ret_int)
+{
+    koopa_raw_function_t decl = Find_decl(prog, name);
+    if (decl != nullptr)
+        return decl;
+
+    vector<const void *> param_types;
+    for (const char *p = params; *p; p++)
+        param_types.push_back(*p == 'p' ? Pointer_type(Int32_type()) : Int32_type());
+    koopa_raw_type_kind_t *ty = new koopa_raw_type_kind_t;
+    ty->tag = KOOPA_RTT_FUNCTION;
+    ty->data.function.params = Make_slice(param_types, KOOPA_RSIK_TYPE);
+    ty->data.function.ret = ret_int ? Int32_type() : Unit_type();
+
+    koopa_raw_function_data_t *data = new koopa_raw_function_data_t;
+    data->ty = ty;
+    data->name = name;
+    data->params = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    data->bbs = Make_slice(vector<const void *>(), KOOPA_RSIK_BASIC_BLOCK);
+    prog->funcs.push_back(new Func_IR(data));
+    return data;
+}
+
+// 用一次__fill_words或__copy_words调用代替整个循环
+static void Replace_idiom(Program_IR *prog, Func_IR *func, const Idiom_loop &idiom)
+{
+    const Counted_loop &info = idiom.info;
+    vector<koopa_raw_value_t> insts;
+
+    koopa_raw_value_t first = New_load(info.var);
+    insts.push_back(first);
+    koopa_raw_value_t dest = Rebuild_at_entry(func, idiom.loop, info.var, idiom.store->kind.data.store.dest, first, insts);
+    koopa_raw_value_t src = idiom.src == nullptr ? nullptr : Rebuild_at_entry(func, idiom.loop, info.var, idiom.src, first, insts);
+    koopa_raw_value_t count = Emit_trip_count(info, first, insts);
+
+    if (idiom.src == nullptr)
+        insts.push_back(New_call(Routine_decl(prog, "@__fill_words", "pii", false), {dest, idiom.store->kind.data.store.value, count}));
+    else insts.push_back(New_call(Routine_decl(prog, "@__copy_words", "ppi", false), {dest, src, count}));
+    Replace_loop(func, idiom.loop, info, first, count, insts);
+}
+
+// 循环惯用法识别（loop idiom recognition）
+// 逐个元素清零、填充或复制数组的循环每次迭代都要计算地址并执行一次store，
+// 替换为对__fill_words、__copy_words的一次调用后由后端输出的例程每次循环写入4个int。
+// 每替换一个循环后重新分析，因为外层循环的块和嵌套关系都变了
+// 这两个例程只在RISC-V汇编中存在，输出Koopa IR时不做替换
+void Loop_idioms(Program_IR *prog, Func_IR *func)
+{
+    if (!opt_options.riscv_target)
+        return;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        Build_CFG(func);
+        Find_loops(func);
+        for (Loop *loop : func->loops)
+        {
+            Idiom_loop idiom;
+            if (Analyze_idiom(func, loop, idiom))
+            {
+                Replace_idiom(prog, func, idiom);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
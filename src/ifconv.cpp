@@ -0,0 +1,170 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 代价模型中的各项，单位为IR指令条数
+#define BRANCH_COST 4 // 难以预测的分支的平均代价（约一半的概率误预测，按惩罚8条指令估计）
+#define SELECT_COST 4 // 用掩码选择一个值：sub、xor、and、xor
+#define SPECULATE_LIMIT 8 // 两边总共可以无条件执行的指令数
+
+// 菱形的一边：计算一个值并存入某个标量变量
+struct Arm
+{
+    vector<koopa_raw_value_t> insts; // store之前的指令
+    koopa_raw_value_t value; // 存入的值
+    koopa_raw_value_t dest; // 被赋值的变量
+};
+
+// 可以无条件执行的指令：没有副作用，也不会访问可能越界的内存
+static bool Is_speculatable(koopa_raw_value_t inst)
+{
+    if (inst->kind.tag == KOOPA_RVT_BINARY) // RISC-V的除法即使除数为0也不会产生异常
+        return true;
+    if (inst->kind.tag == KOOPA_RVT_LOAD)
+    {
+        koopa_raw_value_t src = inst->kind.data.load.src;
+        return src->kind.tag == KOOPA_RVT_ALLOC || src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+    }
+    return false;
+}
+
+// block是否只有head一个前驱、只给一个int变量赋值，然后跳到join
+static bool Match_arm(Func_IR *func, Block_IR *block, Block_IR *head, Block_IR *join, Arm &arm)
+{
+    size_t n = block->insts.size();
+    if (block->preds.size() != 1 || block->preds[0] != head || n < 2)
+        return false;
+    koopa_raw_value_t term = block->Terminator();
+    if (term->kind.tag != KOOPA_RVT_JUMP || func->block_map[term->kind.data.jump.target] != join)
+        return false;
+
+    koopa_raw_value_t store = block->insts[n - 2];
+    if (store->kind.tag != KOOPA_RVT_STORE)
+        return false;
+    koopa_raw_value_t dest = store->kind.data.store.dest;
+    if (dest->kind.tag != KOOPA_RVT_ALLOC && dest->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
+        return false;
+    if (dest->ty->data.pointer.base->tag != KOOPA_RTT_INT32)
+        return false;
+
+    for (size_t i = 0; i + 2 < n; i++)
+        if (!Is_speculatable(block->insts[i]))
+            return false;
+    arm.insts.assign(block->insts.begin(), block->insts.end() - 2);
+    arm.value = store->kind.data.store.value;
+    arm.dest = dest;
+    return true;
+}
+
+static bool Is_compare(koopa_raw_value_t value)
+{
+    if (value->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    switch (value->kind.data.binary.op)
+    {
+    case KOOPA_RBO_EQ: case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_LT: case KOOPA_RBO_GT:
+    case KOOPA_RBO_LE: case KOOPA_RBO_GE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 尝试把以head结尾的br开始的菱形（或三角形）改为无分支的选择，成功时返回true
+static bool Convert(Func_IR *func, Block_IR *head)
+{
+    koopa_raw_value_t term = head->Terminator();
+    if (term->kind.tag != KOOPA_RVT_BRANCH || Is_const(term->kind.data.branch.cond))
+        return false;
+    koopa_raw_value_t cond = term->kind.data.branch.cond;
+    Block_IR *t = func->block_map[term->kind.data.branch.true_bb];
+    Block_IR *f = func->block_map[term->kind.data.branch.false_bb];
+    if (t == f || t == head || f == head)
+        return false;
+
+    // 菱形：两边都赋值后跳到同一个块；三角形：只有一边赋值，另一边直接跳到汇合块
+    Arm arm_t, arm_f;
+    bool has_t = false, has_f = false;
+    if (t->Terminator()->kind.tag == KOOPA_RVT_JUMP)
+    {
+        Block_IR *join = func->block_map[t->Terminator()->kind.data.jump.target];
+        has_t = Match_arm(func, t, head, join, arm_t);
+        has_f = has_t && join != f && Match_arm(func, f, head, join, arm_f);
+        if (has_t && !has_f && join != f)
+            return false;
+    }
+    if (!has_t)
+    {
+        if (f->Terminator()->kind.tag != KOOPA_RVT_JUMP)
+            return false;
+        Block_IR *join = func->block_map[f->Terminator()->kind.data.jump.target];
+        if (join != t || !Match_arm(func, f, head, join, arm_f))
+            return false;
+        has_f = true;
+    }
+    if (has_t && has_f && arm_t.dest != arm_f.dest)
+        return false;
+    koopa_raw_value_t dest = has_t ? arm_t.dest : arm_f.dest;
+
+    // 代价模型：两边的指令都要执行，再加上选择；原来只执行其中一边，但要付出分支的代价
+    int speculated = arm_t.insts.size() + arm_f.insts.size();
+    int converted = speculated + SELECT_COST + 1 + (Is_compare(cond) ? 0 : 1) + (has_t && has_f ? 0 : 1);
+    int branchy = 1 + max(arm_t.insts.size(), arm_f.insts.size()) + 1 + 1 + BRANCH_COST;
+    if (speculated > SPECULATE_LIMIT || converted > branchy)
+        return false;
+
+    vector<koopa_raw_value_t> insts(head->insts.begin(), head->insts.end() - 1);
+    insts.insert(insts.end(), arm_t.insts.begin(), arm_t.insts.end());
+    insts.insert(insts.end(), arm_f.insts.begin(), arm_f.insts.end());
+    // 没有赋值的一边保持变量原来的值
+    koopa_raw_value_t value_t, value_f;
+    if (has_t)
+        value_t = arm_t.value;
+    else insts.push_back(value_t = New_load(dest));
+    if (has_f)
+        value_f = arm_f.value;
+    else insts.push_back(value_f = New_load(dest));
+
+    // mask = -(cond != 0)，结果为 value_f ^ ((value_t ^ value_f) & mask)
+    if (!Is_compare(cond))
+        insts.push_back(cond = New_binary(KOOPA_RBO_NOT_EQ, cond, New_integer(0)));
+    koopa_raw_value_t mask = New_binary(KOOPA_RBO_SUB, New_integer(0), cond);
+    koopa_raw_value_t diff = New_binary(KOOPA_RBO_XOR, value_t, value_f);
+    koopa_raw_value_t masked = New_binary(KOOPA_RBO_AND, diff, mask);
+    koopa_raw_value_t select = New_binary(KOOPA_RBO_XOR, masked, value_f);
+    insts.push_back(mask);
+    insts.push_back(diff);
+    insts.push_back(masked);
+    insts.push_back(select);
+    insts.push_back(New_store(select, dest));
+
+    Block_IR *join = has_t ? func->block_map[t->Terminator()->kind.data.jump.target] : t;
+    insts.push_back(New_jump(join));
+    head->insts = insts;
+
+    func->blocks.erase(remove_if(func->blocks.begin(), func->blocks.end(), [&](Block_IR *block) {
+        return (has_t && block == t) || (has_f && block == f);
+    }), func->blocks.end());
+    return true;
+}
+
+// if转换（if-conversion）
+// 只给同一个变量赋值的小if/else（如min、max、abs、clamp）改为用比较结果构造掩码来选择值，
+// 消除难以预测的分支。代价模型见文件开头
+// 目前后端把每个值都存到栈上，一条IR指令要翻译成三四条机器指令，而分支只需要一两条，
+// 所以只有在分支误预测代价较高的处理器上才有收益，默认不打开
+void If_convert(Func_IR *func)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        Build_CFG(func);
+        for (Block_IR *block : func->blocks)
+            if (block->rpo >= 0 && Convert(func, block))
+            {
+                changed = true;
+                break;
+            }
+    }
+}
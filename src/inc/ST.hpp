@@ -25,8 +25,10 @@ struct ST_item {
     ST_item_t type;
     int dim_num; // 数组维数
     int value;
-    
-    ST_item(ST_item_t ty = NO_TYPE, int d = 0, int v = 0): type(ty), dim_num(d), value(v) {}
+    const vector<int> *dims; // 常量数组的各维长度
+    const vector<int> *values; // 常量数组展开后的初始值，用于在编译期求出下标为常数的元素
+
+    ST_item(ST_item_t ty = NO_TYPE, int d = 0, int v = 0): type(ty), dim_num(d), value(v), dims(nullptr), values(nullptr) {}
 };
 
 // 单个block的符号表
@@ -109,6 +111,8 @@ public:
         st_stack[n-1].s_table[ident].type = item.type;
         st_stack[n-1].s_table[ident].dim_num = item.dim_num;
         st_stack[n-1].s_table[ident].value = item.value;
+        st_stack[n-1].s_table[ident].dims = item.dims;
+        st_stack[n-1].s_table[ident].values = item.values;
     }
 
     // 修改ident对应的表项信息
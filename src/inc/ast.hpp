@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <sstream>
 #include <iostream>
 #include "koopa_ir.hpp"
 #include <cassert>
@@ -11,6 +12,7 @@
 using namespace std;
 
 class Register;
+class BaseAST;
 
 extern ST_stack sym_table;
 extern bool ret; // 是否遇到return
@@ -21,6 +23,9 @@ extern stack<int> while_stack;
 extern int while_remain_num;
 extern int tmp_addr;
 extern int tmp_reg;
+extern string reg_prefix;
+extern string const_arr_defs;
+extern bool fill_words_used;
 string Var_name(string ident, int num);
 string if_stmt_name(string ident, int num);
 string logic_name(string ident, int num);
@@ -28,9 +33,11 @@ string func_name(string ident, int num);
 string Arg_name(string ident, int num);
 string Arr_name(string ident, int num);
 string Ptr_name(string ident, int num);
-void Arrange_alloc(vector<int> dims, ostream &os);
-void Arrange_init_list(vector<Register> regs_list, int begin, int end, vector<int> dims, ostream &os);
-void Store_arr(vector<Register> regs_list, vector<int> dims, int depth, string base, ostream &os);
+void Arrange_alloc(const vector<int> &dims, ostream &os);
+void Arrange_init_list(const vector<Register> &regs_list, int begin, int end, const vector<int> &dims, int depth, ostream &os);
+void Store_arr(const vector<Register> &regs_list, const vector<int> &dims, int depth, const string &base, ostream &os);
+void Init_arr(const vector<Register> &regs_list, const vector<int> &dims, const string &base, ostream &os);
+vector<Register> Flatten_arr(BaseAST *init_list, const vector<int> &dims);
 
 // 寄存器类
 class Register
@@ -62,7 +69,7 @@ public:
     friend ostream& operator << (ostream &os, const Register &reg)
     {
         if (reg.is_var)
-            os << "%" << reg.num;
+            os << "%" << reg_prefix << reg.num;
         else os << reg.value;
         return os;
     }
@@ -80,6 +87,19 @@ public:
     virtual int Value() const {return INT32_MAX;}  // 表达式求值
     virtual void Semantic() = 0; // 语义分析
 
+    // 作为if、while的条件输出：值非0时跳到true_label，否则跳到false_label
+    // 默认先求出表达式的值再br，逻辑表达式会重写它，直接输出短路的跳转
+    virtual void DumpCond(ostream &os, const string &true_label, const string &false_label) const
+    {
+        if (!reg.is_var)
+        {
+            os << "jump " << (reg.value ? true_label : false_label) << endl;
+            return;
+        }
+        DumpIR(os);
+        os << "br " << reg << ", " << true_label << ", " << false_label << endl;
+    }
+
     // 专门用于解析dims维数组的初始化列表，将其补充至dims相应长度
     virtual vector<Register> Parse_list(vector<int> dims) 
     {
@@ -88,8 +108,14 @@ public:
         return reg_list;
     }
     virtual void DumpArg(ostream &os, Register reg = Register()) const {} // 专门用于输出函数参数分配实际地址的内容 
+
+    // 把数组的初始化列表按行优先展开，追加到buf的末尾
+    // 该列表对应的子数组维数为dims[depth..]，展开后补0至子数组的长度
+    virtual void Flatten_list(const vector<int> &dims, int depth, vector<Register> &buf) const {}
 };
 
+void Flatten_init(const vector<unique_ptr<BaseAST>> &init_lists, const vector<int> &dims, int depth, vector<Register> &buf);
+
 
 // CompUnit ::= [CompUnit] Def;
 class CompUnitAST : public BaseAST
@@ -117,13 +143,22 @@ public:
         os << "decl @putch(i32)" << endl;
         os << "decl @putarray(i32, *i32)" << endl;
         os << "decl @starttime()" << endl;
-        os << "decl @stoptime()" << endl << endl;
+        os << "decl @stoptime()" << endl;
 
+        // 先输出各个定义，才知道局部数组的初始化是否用到了__fill_words
+        ostringstream defs_ir;
         for (int i = 0; i < defs.size(); i++)
         {
-            defs[i]->DumpIR(os);
-            os << endl;
+            defs[i]->DumpIR(defs_ir);
+            defs_ir << endl;
         }
+        if (fill_words_used)
+            os << "decl @__fill_words(*i32, i32, i32)" << endl; // 后端输出的例程（见riscv.cpp），不在运行时库中
+        os << endl;
+
+        // 局部常量数组，作为全局变量输出
+        os << const_arr_defs;
+        os << defs_ir.str();
     }
 
     void Semantic() override 
@@ -669,8 +704,7 @@ public:
         string end_label = if_stmt_name("end", if_num);
         bool eof_then;
 
-        exp->DumpIR(os);
-        os << "br " << exp->reg << ", " << then_label << ", " << end_label << endl;
+        exp->DumpCond(os, then_label, end_label);
 
         os << endl << then_label << ":" << endl;
         stmt->DumpIR(os);
@@ -714,8 +748,7 @@ public:
         string end_label = if_stmt_name("end", if_num);
         // bool eof_then, eof_else; // 记录then, else分支是否返回
 
-        exp->DumpIR(os);
-        os << "br " << exp->reg << ", " << then_label << ", " << else_label << endl;
+        exp->DumpCond(os, then_label, else_label);
 
         os << endl << then_label << ":" << endl;
         then_stmt->DumpIR(os);
@@ -763,17 +796,19 @@ public:
         reg.num = stmt->reg.num + 1;
     }
 
+    // 循环旋转：先判断一次条件决定是否进入循环，条件判断放在循环体之后
+    // 这样每次迭代只需执行一次条件跳转（循环体末尾跳到紧随其后的while_entry，后端不会输出这条jump）
+    // while_entry是循环底部的条件判断，continue跳到这里
     void DumpIR(ostream &os) const override
     {
         string entry_label = if_stmt_name("while_entry", while_num);
         string body_label = if_stmt_name("while_body", while_num);
         string end_label = if_stmt_name("while_end", while_num);
 
-        os << "jump " << entry_label << endl;
-        
-        os << endl << entry_label << ":" << endl;
-        exp->DumpIR(os);
-        os << "br " << exp->reg << ", " << body_label << ", " << end_label << endl;
+        // 入口处的条件判断。条件表达式会被输出两次，这一份的寄存器加上前缀以免重名
+        reg_prefix = logic_name("while_guard", while_num) + "_";
+        exp->DumpCond(os, body_label, end_label);
+        reg_prefix = "";
 
         os << endl << body_label << ":" << endl;
         stmt->DumpIR(os);
@@ -782,6 +817,9 @@ public:
             os << "jump " << entry_label << endl;
         ret = false; // while循环中一定不会使整个程序return.
 
+        os << endl << entry_label << ":" << endl;
+        exp->DumpCond(os, body_label, end_label);
+
         os << endl << end_label << ":" << endl; // 这里，我们假设while循环之后一定还有语句（至少应该有return语句）
     }
 
@@ -865,6 +903,10 @@ public:
         if (!reg.is_var) return;
         loexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        loexp->DumpCond(os, true_label, false_label);
+    }
     void Semantic() override
     {
         loexp->Semantic();
@@ -894,6 +936,10 @@ public:
         if (!reg.is_var) return;
         exp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        exp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override 
     {
@@ -1044,6 +1090,10 @@ public:
         if (!reg.is_var) return;
         pexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        pexp->DumpCond(os, true_label, false_label);
+    }
     void Semantic() override
     {
         pexp->Semantic();
@@ -1086,6 +1136,13 @@ public:
 
         else return;
     }
+    // 取负不改变是否为0；取非只需交换两个目标
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        if (uop == "!")
+            uexp->DumpCond(os, false_label, true_label);
+        else uexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1127,6 +1184,10 @@ public:
         if (!reg.is_var) return;
         uexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        uexp->DumpCond(os, true_label, false_label);
+    }
     void Semantic() override 
     {
         uexp->Semantic();
@@ -1234,6 +1295,10 @@ public:
         if (!reg.is_var) return;
         mexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        mexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1321,6 +1386,10 @@ public:
         if (!reg.is_var) return;
         aexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        aexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1427,6 +1496,10 @@ public:
         if (!reg.is_var) return;
         rexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        rexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1533,6 +1606,10 @@ public:
         if (!reg.is_var) return;
         eexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        eexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1593,6 +1670,23 @@ public:
         os << reg << " = load @" << log_name << endl;
     }
 
+    // 作为条件时不需要保存结果：左边为0直接跳到false_label，否则再判断右边
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        if (!reg.is_var)
+        {
+            BaseAST::DumpCond(os, true_label, false_label);
+            return;
+        }
+
+        if_stmt_num++;
+        string rhs_label = if_stmt_name("and_rhs", if_stmt_num);
+        laexp->DumpCond(os, rhs_label, false_label);
+
+        os << endl << rhs_label << ":" << endl;
+        eexp->DumpCond(os, true_label, false_label);
+    }
+
     void Semantic() override
     {
         laexp->Semantic();
@@ -1625,6 +1719,10 @@ public:
         if (!reg.is_var) return;
         laexp->DumpIR(os);
     }
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        laexp->DumpCond(os, true_label, false_label);
+    }
 
     void Semantic() override
     {
@@ -1684,6 +1782,23 @@ public:
         os << reg << " = load @" << log_name << endl;
     }
 
+    // 作为条件时不需要保存结果：左边非0直接跳到true_label，否则再判断右边
+    void DumpCond(ostream &os, const string &true_label, const string &false_label) const override
+    {
+        if (!reg.is_var)
+        {
+            BaseAST::DumpCond(os, true_label, false_label);
+            return;
+        }
+
+        if_stmt_num++;
+        string rhs_label = if_stmt_name("or_rhs", if_stmt_num);
+        loexp->DumpCond(os, true_label, rhs_label);
+
+        os << endl << rhs_label << ":" << endl;
+        laexp->DumpCond(os, true_label, false_label);
+    }
+
     void Semantic() override
     {
         loexp->Semantic();
@@ -1937,12 +2052,10 @@ public:
         return const_exp->Value();
     }
 
-    vector<Register> Parse_list(vector<int> dims) override 
+    void Flatten_list(const vector<int> &dims, int depth, vector<Register> &buf) const override
     {
-        // 当parse一个constexp时，无论期望的数组形状如何，永远返回一个单元集
-        vector<Register> regs_list;
-        regs_list.push_back(reg);
-        return regs_list;
+        // 单个constexp，无论期望的数组形状如何，都只占一个元素
+        buf.push_back(reg);
     }
 };
 
@@ -1970,12 +2083,10 @@ public:
         reg.value = exp->reg.value;
     }
 
-    vector<Register> Parse_list(vector<int> dims) override 
+    void Flatten_list(const vector<int> &dims, int depth, vector<Register> &buf) const override
     {
-        // 当parse一个exp时，无论期望的数组形状如何，永远返回一个单元集
-        vector<Register> regs_list;
-        regs_list.push_back(reg);
-        return regs_list;
+        // 单个exp，无论期望的数组形状如何，都只占一个元素
+        buf.push_back(reg);
     }
 };
 
@@ -2097,6 +2208,8 @@ public:
 };
 
 // ConstDef ::= IDENT { "[" ConstExp "]" } "=" ConstInitVal;
+// 常量数组的内容在语义分析时就已确定，保存在符号表中
+// 局部常量数组不必每次进入作用域时都初始化，也作为全局变量输出，后端会把它放在只读数据段
 class ConstDef_Arr_AST: public BaseAST
 {
 public: 
@@ -2104,6 +2217,7 @@ public:
     vector<unique_ptr<BaseAST>> constexps;
     unique_ptr<BaseAST> init_list; // 初始化列表
     vector<int> dims;
+    vector<int> values; // 展开后的初始值
     string ir_name;
     bool is_glob;
 
@@ -2115,32 +2229,24 @@ public:
 
     void DumpIR(ostream &os) const override 
     {
-        // 解析初始列表
-        vector<Register> regs_list = init_list->Parse_list(dims);
-
-        // 全局数组，直接初始化输出
+        // 局部常量数组已经在const_arr_defs中输出
         if (is_glob)
-        {
-            os << "global @" << ir_name << " = alloc ";
-            Arrange_alloc(dims, os);
-            os << ", ";
-            Arrange_init_list(regs_list, 0, regs_list.size(), dims, os);
-            os << endl;
-        }
-        
-        // 局部数组，store
-        else 
-        {
-            os << "@" << ir_name << " = alloc ";
-            Arrange_alloc(dims, os);
-            os << endl;
-
-            // store.
-            tmp_reg = 0;
-            Store_arr(regs_list, dims, 0, "@" + ir_name, os);
-        }    
+            Dump_global(os);
     }
 
+    void Dump_global(ostream &os) const
+    {
+        vector<Register> regs_list;
+        regs_list.reserve(values.size());
+        for (int i = 0; i < values.size(); i++)
+            regs_list.push_back(Register(0, values[i], false));
+
+        os << "global @" << ir_name << " = alloc ";
+        Arrange_alloc(dims, os);
+        os << ", ";
+        Arrange_init_list(regs_list, 0, regs_list.size(), dims, 0, os);
+        os << endl;
+    }
 
     void Semantic() override 
     {
@@ -2157,9 +2263,26 @@ public:
             
         init_list->Semantic();
 
-        sym_table.add_item(ident, ST_item(ARRAY_CONST, constexps.size()));
+        vector<Register> regs_list = Flatten_arr(init_list.get(), dims);
+        for (int i = 0; i < regs_list.size(); i++)
+        {
+            assert(!regs_list[i].is_var);
+            values.push_back(regs_list[i].value);
+        }
+
+        ST_item item(ARRAY_CONST, constexps.size());
+        item.dims = &dims;
+        item.values = &values;
+        sym_table.add_item(ident, item);
         ir_name = Arr_name(ident, sym_table.top_num);
 
+        if (!is_glob)
+        {
+            ostringstream defs;
+            Dump_global(defs);
+            const_arr_defs += defs.str() + "\n";
+        }
+
         reg.is_var = true;
         reg.value = 0;
     }
@@ -2241,7 +2364,7 @@ public:
         init_list->DumpIR(os);
 
         // 解析初始列表
-        vector<Register> regs_list = init_list->Parse_list(dims);
+        vector<Register> regs_list = Flatten_arr(init_list.get(), dims);
 
         // 全局数组，直接初始化输出
         if (is_glob)
@@ -2249,7 +2372,7 @@ public:
             os << "global @" << ir_name << " = alloc ";
             Arrange_alloc(dims, os);
             os << ", ";
-            Arrange_init_list(regs_list, 0, regs_list.size(), dims, os);
+            Arrange_init_list(regs_list, 0, regs_list.size(), dims, 0, os);
             os << endl;
         }
         
@@ -2261,8 +2384,7 @@ public:
             os << endl;
 
             // store.
-            tmp_reg = 0;
-            Store_arr(regs_list, dims, 0, "@" + ir_name, os);
+            Init_arr(regs_list, dims, "@" + ir_name, os);
         }
     }
 
@@ -2319,50 +2441,10 @@ public:
         reg.value = 0;
     }
 
-    // 解析初始化列表，返回一个寄存器类型的vector，表示按序排好的所有初始值
-    vector<Register> Parse_list(vector<int> dims) override
+    // 展开初始化列表，得到按序排好的所有初始值
+    void Flatten_list(const vector<int> &dims, int depth, vector<Register> &buf) const override
     {
-        assert(!dims.empty());
-
-        vector<Register> regs_list;
-        int n = init_lists.size();
-        int m = dims.size();
-        int sum = 0; // 已完成解析的总长度
-
-        for (int i = 0; i < n; i++)
-        {
-            // 根据sum确定在哪一维处对齐
-            int s = sum;
-            int j;
-            vector<int> new_dims;
-            for (j = m - 1; j >= 0; j--)
-            {
-                if (s % dims[j] != 0)
-                    break;
-                s = s / dims[j];
-            }
-
-            for (int l = max(1, j + 1); l < m; l++)
-                new_dims.push_back(dims[l]);
-
-            // 解析init_lists[i]
-            vector<Register> regs_tmp = init_lists[i]->Parse_list(new_dims);
-
-            // 更新
-            sum += regs_tmp.size();
-            regs_list.insert(regs_list.end(), regs_tmp.begin(), regs_tmp.end());
-        }
-
-        // 补0；
-        int prod = 1; // 数组的期望长度
-        for (int i = 0; i < m; i++)
-            prod *= dims[i];
-
-        int size = regs_list.size();
-        for (int i = size; i < prod; i++)
-            regs_list.push_back(Register(0, 0, false));
-
-        return regs_list;
+        Flatten_init(init_lists, dims, depth, buf);
     }
 };
 
@@ -2398,49 +2480,9 @@ public:
         reg.value = 0;
     }
 
-    vector<Register> Parse_list(vector<int> dims) override
+    void Flatten_list(const vector<int> &dims, int depth, vector<Register> &buf) const override
     {
-        assert(!dims.empty());
-
-        vector<Register> regs_list;
-        int n = init_lists.size();
-        int m = dims.size();
-        int sum = 0; // 已完成解析的总长度
-
-        for (int i = 0; i < n; i++)
-        {
-            // 根据sum确定在哪一维处对齐
-            int s = sum;
-            int j;
-            vector<int> new_dims;
-            for (j = m - 1; j >= 0; j--)
-            {
-                if (s % dims[j] != 0)
-                    break;
-                s = s / dims[j];
-            }
-
-            for (int l = max(1, j + 1); l < m; l++)
-                new_dims.push_back(dims[l]);
-
-            // 解析init_lists[i]
-            vector<Register> regs_tmp = init_lists[i]->Parse_list(new_dims);
-
-            // 更新
-            sum += regs_tmp.size();
-            regs_list.insert(regs_list.end(), regs_tmp.begin(), regs_tmp.end());
-        }
-
-        // 补0；
-        int prod = 1; // 数组的期望长度
-        for (int i = 0; i < m; i++)
-            prod *= dims[i];
-
-        int size = regs_list.size();
-        for (int i = size; i < prod; i++)
-            regs_list.push_back(Register(0, 0, false));
-
-        return regs_list;
+        Flatten_init(init_lists, dims, depth, buf);
     }
 };
 
@@ -2468,6 +2510,7 @@ public:
 
     void DumpIR(ostream &os) const override
     {
+        if (!reg.is_var) return;
         for (int i = 0; i < exps.size(); i++)
             exps[i]->DumpIR(os);
 
@@ -2516,6 +2559,25 @@ public:
 
         // 比较pr.first.dim_num和exps.size()判断是不是指针
         is_ptr = (pr.first.dim_num > exps.size());
+
+        // 常量数组的下标都是常数时，在编译期求出元素的值
+        if (type == ARRAY_CONST && !is_ptr && pr.first.values != nullptr)
+        {
+            const vector<int> &dims = *pr.first.dims;
+            int index = 0;
+            bool is_const = true;
+            for (int i = 0; i < exps.size() && is_const; i++)
+            {
+                int k = exps[i]->reg.value;
+                is_const = !exps[i]->reg.is_var && k >= 0 && k < dims[i];
+                index = index * dims[i] + k;
+            }
+            if (is_const)
+            {
+                reg.is_var = false;
+                reg.value = (*pr.first.values)[index];
+            }
+        }
     }
 
     // 借用这个函数处理store的情况，把reg store到lval对应的地址中
@@ -0,0 +1,212 @@
+#pragma once
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "koopa.h"
+
+using namespace std;
+
+// 优化选项
+struct Opt_options
+{
+    int level; // 优化等级，0表示不做任何优化
+    bool dce; // 死代码删除
+    bool tail_calls; // 尾递归消除，以及后端的尾调用
+    bool ipcp; // 过程间常量传播与函数特化
+    bool memoize; // 纯递归函数的自动记忆化，默认关闭，用-fmemoize打开
+    bool inline_funcs; // 函数内联
+    bool strip_dead; // 删除从main不可达的函数和未被引用的全局变量
+    int inline_limit; // 可以被内联的函数的最大指令数
+    bool interchange; // 循环交换
+    bool loop_idioms; // 把填充、复制数组的循环替换为__fill_words、__copy_words
+    bool licm; // 循环不变量外提
+    bool promote_globals; // 循环中的全局变量提升为局部变量
+    bool vectorize; // RVV自动向量化，默认关闭，用-fvectorize打开
+    bool strength_reduce; // 归纳变量强度削弱
+    bool unroll; // 循环展开
+    int unroll_factor; // 部分展开时每次迭代执行的循环体份数
+    bool if_convert; // if转换，默认关闭，用-fif-convert打开
+    bool load_elim; // 冗余load删除与store到load的转发
+    bool dse; // 死store删除
+    bool riscv_target; // 输出RISC-V汇编时为true，这时才能调用后端输出的内部例程（__fill_words等），不由命令行选项控制
+
+    Opt_options(): level(0), dce(true), tail_calls(true), ipcp(true), memoize(false), inline_funcs(true), strip_dead(true), inline_limit(40), interchange(true), loop_idioms(true), licm(true), promote_globals(true), vectorize(false), strength_reduce(true), unroll(true), unroll_factor(4), if_convert(false), load_elim(true), dse(true), riscv_target(false) {}
+};
+
+extern Opt_options opt_options;
+bool Parse_option(const char *arg);
+
+// 优化阶段使用的可修改的基本块
+// raw中的slice不便于插入、删除，所以优化时把指令拷贝到vector中，优化结束后再写回raw
+class Block_IR
+{
+public:
+    koopa_raw_basic_block_data_t *bb;
+    vector<koopa_raw_value_t> insts;
+    vector<Block_IR *> preds; // 可达的前驱
+    vector<Block_IR *> succs; // 后继
+    Block_IR *idom; // 直接支配者
+    int rpo; // 逆后序编号，-1表示从入口不可达
+
+    Block_IR(koopa_raw_basic_block_data_t *b): bb(b), idom(nullptr), rpo(-1) {}
+
+    // 基本块的最后一条指令（br/jump/ret）
+    koopa_raw_value_t Terminator() const
+    {
+        assert(!insts.empty());
+        return insts.back();
+    }
+};
+
+// 循环（自然循环）
+class Loop
+{
+public:
+    Block_IR *header;
+    Block_IR *preheader; // 循环外唯一跳到header的块，由Insert_preheader创建
+    set<Block_IR *> blocks; // 循环中的所有块（包括header）
+    vector<Block_IR *> latches; // 跳回header的块
+    Loop *parent;
+    vector<Loop *> children;
+    int depth;
+
+    Loop(Block_IR *h): header(h), preheader(nullptr), parent(nullptr), depth(1) {}
+
+    bool Contains(Block_IR *block) const { return blocks.count(block) != 0; }
+    // 有后继在循环外的块
+    vector<Block_IR *> Exiting_blocks() const;
+};
+
+// 基本归纳变量：循环中每次赋值都形如 i = i + c 的局部变量
+struct Induction_var
+{
+    koopa_raw_value_t var; // alloc i32
+    map<koopa_raw_value_t, int> steps; // 循环中对var的每条store及其增量
+};
+
+// 计数循环：每次迭代恰好执行一次 i = i + step，latch中根据 i op bound 决定是否继续
+// 这正是Stmt2While_AST旋转后的while循环中最常见的形式
+struct Counted_loop
+{
+    Block_IR *latch;
+    koopa_raw_value_t store; // 循环中唯一的一条 i = i + step
+    Block_IR *exit; // latch条件不成立时跳到的块
+    koopa_raw_value_t var; // 归纳变量
+    int step;
+    koopa_raw_value_t cond; // latch中的比较
+    bool iv_left; // 比较时归纳变量是否在左边
+    koopa_raw_binary_op_t op; // 把归纳变量放在左边时的比较运算
+    koopa_raw_value_t bound; // 循环中不变的边界
+};
+
+// 优化阶段使用的函数
+class Func_IR
+{
+public:
+    koopa_raw_function_data_t *func;
+    vector<Block_IR *> blocks; // 按输出顺序排列，blocks[0]是入口
+    vector<Block_IR *> rpo_order; // 可达块的逆后序
+    map<koopa_raw_basic_block_t, Block_IR *> block_map;
+    map<koopa_raw_value_t, Block_IR *> def_block; // 指令所在的基本块
+    vector<Loop *> loops; // 所有循环，内层循环在前
+
+    Func_IR(koopa_raw_function_data_t *f): func(f) {}
+
+    bool Is_decl() const { return blocks.empty(); }
+    bool Dominates(Block_IR *a, Block_IR *b) const;
+};
+
+// 优化阶段使用的程序
+class Program_IR
+{
+public:
+    koopa_raw_program_t *raw;
+    vector<koopa_raw_value_t> values; // 全局变量
+    vector<Func_IR *> funcs; // 所有函数（包括库函数声明）
+};
+
+// IR 构造与修改
+koopa_raw_type_t Int32_type();
+koopa_raw_type_t Unit_type();
+koopa_raw_type_t Pointer_type(koopa_raw_type_t base);
+koopa_raw_type_t Array_type(koopa_raw_type_t base, int len);
+int Type_size(koopa_raw_type_t ty);
+koopa_raw_slice_t Make_slice(const vector<const void *> &items, koopa_raw_slice_item_kind_t kind);
+koopa_raw_value_data_t *New_value(koopa_raw_type_t ty, koopa_raw_value_tag_t tag);
+koopa_raw_value_t New_integer(int value);
+koopa_raw_value_t New_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+koopa_raw_value_t New_load(koopa_raw_value_t src);
+koopa_raw_value_t New_store(koopa_raw_value_t value, koopa_raw_value_t dest);
+koopa_raw_value_t New_alloc(koopa_raw_type_t base, string prefix);
+koopa_raw_value_t New_global(koopa_raw_type_t base, string prefix);
+koopa_raw_value_t New_getelemptr(koopa_raw_value_t src, koopa_raw_value_t index);
+koopa_raw_value_t New_ret(koopa_raw_value_t value);
+koopa_raw_value_t New_call(koopa_raw_function_t callee, const vector<koopa_raw_value_t> &args);
+koopa_raw_value_t New_jump(Block_IR *target);
+koopa_raw_value_t New_branch(koopa_raw_value_t cond, Block_IR *true_block, Block_IR *false_block);
+Block_IR *New_block(string prefix);
+koopa_raw_value_data_t *Mut(koopa_raw_value_t value);
+vector<koopa_raw_value_t *> Operands(koopa_raw_value_t value);
+void Replace_uses(Func_IR *func, koopa_raw_value_t from, koopa_raw_value_t to);
+koopa_raw_value_t Clone_inst(koopa_raw_value_t inst);
+vector<Block_IR *> Clone_blocks(const vector<Block_IR *> &blocks, map<koopa_raw_value_t, koopa_raw_value_t> &value_map);
+bool Remove_unused(Func_IR *func);
+void Replace_target(koopa_raw_value_t term, Block_IR *from, Block_IR *to);
+bool Is_terminator(koopa_raw_value_t value);
+bool Is_const(koopa_raw_value_t value);
+
+// 分析
+Program_IR *Build_program(koopa_raw_program_t &program);
+void Commit_program(Program_IR *prog);
+void Build_CFG(Func_IR *func);
+void Find_loops(Func_IR *func);
+Block_IR *Insert_preheader(Func_IR *func, Loop *loop);
+vector<Induction_var> Find_induction_vars(Func_IR *func, Loop *loop);
+bool Analyze_loop(Func_IR *func, Loop *loop, Counted_loop &info);
+bool Find_init(Loop *loop, koopa_raw_value_t var, int &init);
+
+// 用直线代码和后端例程的调用代替整个计数循环
+bool Is_unit_stride(koopa_raw_value_t addr, koopa_raw_value_t var);
+bool Scan_single_store(Loop *loop, const Counted_loop &info, koopa_raw_value_t &store, vector<koopa_raw_value_t> &loads);
+koopa_raw_value_t Rebuild_at_entry(Func_IR *func, Loop *loop, koopa_raw_value_t var, koopa_raw_value_t value, koopa_raw_value_t first,
+                                   vector<koopa_raw_value_t> &insts);
+koopa_raw_value_t Emit_trip_count(const Counted_loop &info, koopa_raw_value_t first, vector<koopa_raw_value_t> &insts);
+void Replace_loop(Func_IR *func, Loop *loop, const Counted_loop &info, koopa_raw_value_t first, koopa_raw_value_t count,
+                  vector<koopa_raw_value_t> &insts);
+koopa_raw_function_t Routine_decl(Program_IR *prog, const char *name, const char *params, bool ret_int);
+
+// 别名分析
+// 两个指针指向的内存的关系。查询针对同一时刻的两个地址：相同的SSA值代表相同的运行时值
+enum Alias_result
+{
+    NO_ALIAS, // 一定不重叠
+    MAY_ALIAS, // 可能重叠
+    MUST_ALIAS, // 一定是同一个位置
+};
+koopa_raw_value_t Mem_base(koopa_raw_value_t ptr);
+Alias_result Alias(koopa_raw_value_t a, koopa_raw_value_t b);
+bool Call_may_access(koopa_raw_value_t call, koopa_raw_value_t ptr);
+vector<koopa_raw_value_t> Local_scalars(Func_IR *func);
+
+// 优化遍
+void Optimize(koopa_raw_program_t &program);
+void Dce(Func_IR *func);
+void Tail_recursion(Func_IR *func);
+void Ipcp(Program_IR *prog);
+void Memoize_recursion(Program_IR *prog);
+void Inline(Program_IR *prog);
+void Strip_dead(Program_IR *prog);
+void Interchange_loops(Func_IR *func);
+void Loop_idioms(Program_IR *prog, Func_IR *func);
+void Licm(Func_IR *func);
+void Promote_globals(Func_IR *func);
+void Vectorize(Program_IR *prog, Func_IR *func);
+void Strength_reduce(Func_IR *func);
+void Unroll(Func_IR *func);
+void If_convert(Func_IR *func);
+void Forward_loads(Func_IR *func);
+void Dead_store_elim(Func_IR *func);
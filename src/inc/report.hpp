@@ -0,0 +1,54 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 编译时间与内存报告的选项，与优化选项一样放在命令行的4个标准参数之后
+struct Report_options
+{
+    bool time_passes; // -time-passes：每个阶段和优化遍的墙钟时间、CPU时间
+    bool mem_report; // -mem-report：每个阶段常驻内存（RSS）的变化量和结束时的峰值
+    bool json; // -report-format=json：输出JSON而不是表格
+
+    Report_options(): time_passes(false), mem_report(false), json(false) {}
+    bool Enabled() const { return time_passes || mem_report; }
+};
+
+extern Report_options report_options;
+bool Parse_report_option(const char *arg);
+
+// 一个阶段的统计。同名阶段（例如对每个函数执行一次的优化遍）多次执行时累加
+struct Phase_record
+{
+    string name;
+    int depth; // 嵌套层数，优化遍在optimize之下
+    int calls;
+    double wall_ms, cpu_ms;
+    long rss_delta_kb; // 执行期间当前RSS的变化量之和
+    long peak_rss_kb; // 最后一次结束时进程的RSS峰值
+};
+
+// 在作用域内计时，析构时记录。报告选项都没有打开时什么也不做
+class Phase_timer
+{
+public:
+    Phase_timer(const char *name);
+    ~Phase_timer();
+
+private:
+    int index; // 在记录中的下标，-1表示不记录
+    double wall_start, cpu_start;
+    long rss_start;
+};
+
+// 计时执行f，用于Optimize中的各个优化遍
+template <typename F>
+void Timed(const char *name, F f)
+{
+    Phase_timer timer(name);
+    f();
+}
+
+void Print_report(ostream &os);
@@ -10,6 +10,9 @@
 #include "koopa.h" // 使用文档提供的文本IR到内存IR转换的标准接口
 #include <map>
 #include <unordered_map>
+#include <sstream>
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 
@@ -19,6 +22,8 @@ void Dist_regs(const koopa_raw_slice_t &slice);
 void Dist_regs(const koopa_raw_function_t &func);
 void Dist_regs(const koopa_raw_basic_block_t &bb);
 void Dist_regs(const koopa_raw_value_t &value);
+void Find_written_globals(const koopa_raw_program_t &program);
+void Find_called_funcs(const koopa_raw_program_t &program);
 void DumpRISC(const koopa_raw_program_t &program, ostream &os);
 void DumpRISC(const koopa_raw_slice_t &slice, ostream &os);
 void DumpRISC(const koopa_raw_function_t &func, ostream &os);
@@ -26,6 +31,9 @@ void DumpRISC(const koopa_raw_basic_block_t &bb, ostream &os);
 void DumpRISC(const koopa_raw_value_t &value, ostream &os);
 void DumpRISC(const koopa_raw_integer_t &integer, ostream &os);
 void DumpRISC(const koopa_raw_return_t &ret, string reg, ostream &os);
+void Epilogue_dump(ostream &os);
+koopa_raw_value_t Tail_call(const koopa_raw_basic_block_t &bb);
+void Tail_call_dump(const koopa_raw_call_t &call, ostream &os);
 void DumpRISC(const koopa_raw_binary_t &binary, ostream &os);
 void DumpRISC(const koopa_raw_global_alloc_t &alloc, ostream &os);
 void DumpRISC(const koopa_raw_load_t &load, ostream &os);
@@ -37,6 +45,13 @@ void DumpRISC(const koopa_raw_global_alloc_t &alloc, const koopa_raw_value_t &va
 void DumpRISC(const koopa_raw_get_elem_ptr_t &getelemptr, const koopa_raw_value_t &value, ostream &os);
 void DumpRISC(const koopa_raw_get_ptr_t &getptr, const koopa_raw_value_t &value, ostream &os);
 void DumpRISC(const koopa_raw_aggregate_t &aggregate, ostream &os);
+bool Near(koopa_raw_basic_block_t target, int range);
+void Far_jump_dump(koopa_raw_basic_block_t target, ostream &os);
+void Jump_dump(koopa_raw_basic_block_t target, ostream &os);
+void Cond_jump_dump(string op, string reg, koopa_raw_basic_block_t target, ostream &os);
+void Div_magic(int d, int &magic, int &shift);
+void Div_const_dump(int d, bool is_mod, ostream &os);
+void Index_dump(const koopa_raw_value_t &index, int size, ostream &os);
 void CheckReg(const koopa_raw_value_t &value);
 bool Load_imm(const koopa_raw_value_t &value, string reg);
 void Load_imm_dump(const koopa_raw_value_t &value, ostream &os);
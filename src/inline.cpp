@@ -0,0 +1,201 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+#define INLINE_LOOP_BONUS 2 // 循环中的调用收益更大，允许的被调用者大小乘以该倍数
+#define CALLER_LIMIT 3000 // 内联后调用者的指令数上限
+#define INLINE_STACK_LIMIT 1024 // 被调用者局部变量占用的栈空间上限（字节）
+
+static int Func_size(Func_IR *func)
+{
+    int size = 0;
+    for (Block_IR *block : func->blocks)
+        size += block->insts.size();
+    return size;
+}
+
+static int Stack_bytes(Func_IR *func)
+{
+    int size = 0;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+                size += Type_size(inst->ty->data.pointer.base);
+    return size;
+}
+
+// 函数直接调用的所有函数
+static vector<koopa_raw_function_t> Callees(Func_IR *func)
+{
+    vector<koopa_raw_function_t> callees;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                callees.push_back(inst->kind.data.call.callee);
+    return callees;
+}
+
+// 调用图中处于环上的函数（直接或间接递归），它们不会被内联
+static set<Func_IR *> Find_recursive(Program_IR *prog, map<koopa_raw_function_t, Func_IR *> &func_of)
+{
+    set<Func_IR *> recursive;
+    for (Func_IR *func : prog->funcs)
+    {
+        set<Func_IR *> visited;
+        vector<Func_IR *> work(1, func);
+        while (!work.empty() && !recursive.count(func))
+        {
+            Func_IR *cur = work.back();
+            work.pop_back();
+            for (auto callee : Callees(cur))
+            {
+                Func_IR *next = func_of[callee];
+                if (next == func)
+                    recursive.insert(func);
+                else if (!visited.count(next))
+                {
+                    visited.insert(next);
+                    work.push_back(next);
+                }
+            }
+        }
+    }
+    return recursive;
+}
+
+// 按调用图的后序排列函数，被调用者在前，这样内联时被调用者已经处理完毕
+static void Post_order(Func_IR *func, map<koopa_raw_function_t, Func_IR *> &func_of, set<Func_IR *> &visited, vector<Func_IR *> &order)
+{
+    visited.insert(func);
+    for (auto callee : Callees(func))
+        if (!visited.count(func_of[callee]))
+            Post_order(func_of[callee], func_of, visited, order);
+    order.push_back(func);
+}
+
+// 把block中第pos条指令（call）替换为被调用者的函数体，返回call之后的指令所在的新块
+static Block_IR *Inline_call(Func_IR *caller, Block_IR *block, size_t pos, Func_IR *callee)
+{
+    koopa_raw_value_t call = block->insts[pos];
+    Block_IR *entry = caller->blocks[0];
+
+    // call之后的指令移到新块中，被调用者的ret改为跳到这里
+    Block_IR *post = New_block("inline_ret");
+    post->insts.assign(block->insts.begin() + pos + 1, block->insts.end());
+    block->insts.resize(pos);
+
+    // 函数参数替换为实参
+    map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    auto &params = callee->func->params;
+    auto &args = call->kind.data.call.args;
+    for (size_t i = 0; i < params.len; i++)
+        value_map[reinterpret_cast<koopa_raw_value_t>(params.buffer[i])] = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+    vector<Block_IR *> body = Clone_blocks(callee->blocks, value_map);
+
+    // 返回值通过一个局部变量传递
+    koopa_raw_value_t ret_var = nullptr;
+    if (call->ty->tag == KOOPA_RTT_INT32)
+    {
+        ret_var = New_alloc(Int32_type(), "inline_ret");
+        entry->insts.insert(entry->insts.begin(), ret_var);
+    }
+
+    vector<koopa_raw_value_t> allocs;
+    for (Block_IR *clone : body)
+    {
+        vector<koopa_raw_value_t> insts;
+        for (auto inst : clone->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+                allocs.push_back(inst);
+            else if (inst->kind.tag == KOOPA_RVT_RETURN)
+            {
+                koopa_raw_value_t value = inst->kind.data.ret.value;
+                if (ret_var != nullptr && value != nullptr)
+                    insts.push_back(New_store(value, ret_var));
+                insts.push_back(New_jump(post));
+            }
+            else insts.push_back(inst);
+        }
+        clone->insts = insts;
+    }
+    // 被调用者的局部变量放到调用者的入口块
+    entry->insts.insert(entry->insts.begin(), allocs.begin(), allocs.end());
+
+    block->insts.push_back(New_jump(body[0]));
+
+    auto it = find(caller->blocks.begin(), caller->blocks.end(), block) + 1;
+    it = caller->blocks.insert(it, body.begin(), body.end()) + body.size();
+    caller->blocks.insert(it, post);
+
+    if (ret_var != nullptr)
+    {
+        koopa_raw_value_t load = New_load(ret_var);
+        post->insts.insert(post->insts.begin(), load);
+        Replace_uses(caller, call, load);
+    }
+    return post;
+}
+
+// 在一个函数中内联所有合适的调用
+static void Inline_func(Func_IR *caller, map<koopa_raw_function_t, Func_IR *> &func_of, const set<Func_IR *> &recursive)
+{
+    Build_CFG(caller);
+    Find_loops(caller);
+
+    // 每个块所在循环的深度
+    map<Block_IR *, int> depth;
+    for (Loop *loop : caller->loops)
+        for (Block_IR *block : loop->blocks)
+            depth[block] = max(depth[block], loop->depth);
+
+    int size = Func_size(caller);
+    vector<Block_IR *> work(caller->blocks.rbegin(), caller->blocks.rend());
+    while (!work.empty())
+    {
+        Block_IR *block = work.back();
+        work.pop_back();
+        for (size_t i = 0; i < block->insts.size(); i++)
+        {
+            koopa_raw_value_t inst = block->insts[i];
+            if (inst->kind.tag != KOOPA_RVT_CALL)
+                continue;
+            Func_IR *callee = func_of[inst->kind.data.call.callee];
+            if (callee == caller || callee->Is_decl() || recursive.count(callee))
+                continue;
+
+            int callee_size = Func_size(callee);
+            int limit = opt_options.inline_limit * (depth[block] > 0 ? INLINE_LOOP_BONUS : 1);
+            if (callee_size > limit || size + callee_size > CALLER_LIMIT || Stack_bytes(callee) > INLINE_STACK_LIMIT)
+                continue;
+
+            // 被内联的函数体已经处理过，不再扫描；继续处理call之后的指令
+            Block_IR *post = Inline_call(caller, block, i, callee);
+            depth[post] = depth[block];
+            size += callee_size;
+            work.push_back(post);
+            break;
+        }
+    }
+    Remove_unused(caller);
+}
+
+// 函数内联（inlining）
+// 被调用者的指令数不超过inline_limit（在循环中放宽为INLINE_LOOP_BONUS倍）时，
+// 把call替换为函数体，省去传参、保存ra以及序言和尾声的开销。递归函数不会被内联
+void Inline(Program_IR *prog)
+{
+    map<koopa_raw_function_t, Func_IR *> func_of;
+    for (Func_IR *func : prog->funcs)
+        func_of[func->func] = func;
+    set<Func_IR *> recursive = Find_recursive(prog, func_of);
+
+    set<Func_IR *> visited;
+    vector<Func_IR *> order;
+    for (Func_IR *func : prog->funcs)
+        if (!visited.count(func))
+            Post_order(func, func_of, visited, order);
+
+    for (Func_IR *func : order)
+        if (!func->Is_decl())
+            Inline_func(func, func_of, recursive);
+}
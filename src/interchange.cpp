@@ -0,0 +1,389 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 完美嵌套的两层计数循环
+struct Loop_nest
+{
+    Loop *outer, *inner;
+    Counted_loop outer_info, inner_info;
+    int outer_init, inner_init;
+    Block_IR *inner_init_block; // 外层循环中给内层归纳变量赋初值的块
+};
+
+// 第一次判断 init op bound 是否成立，即循环至少执行一次
+static bool Enters(const Counted_loop &info, int init)
+{
+    int bound = info.bound->kind.data.integer.value;
+    switch (info.op)
+    {
+    case KOOPA_RBO_LT: return init < bound;
+    case KOOPA_RBO_GT: return init > bound;
+    case KOOPA_RBO_LE: return init <= bound;
+    case KOOPA_RBO_GE: return init >= bound;
+    default: return false;
+    }
+}
+
+// value是否是对var的load
+static bool Is_load_of(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    return value->kind.tag == KOOPA_RVT_LOAD && value->kind.data.load.src == var;
+}
+
+// 表达式中是否用到了var的值
+static bool Uses_var(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    if (Is_load_of(value, var))
+        return true;
+    if (value->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    return Uses_var(value->kind.data.binary.lhs, var) || Uses_var(value->kind.data.binary.rhs, var);
+}
+
+// 两个表达式是否在同一次迭代中一定得到相同的值：结构相同，叶子是相同的常数或对同一变量的load
+static bool Same_expr(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    if (a == b)
+        return true;
+    if (Is_const(a) && Is_const(b))
+        return a->kind.data.integer.value == b->kind.data.integer.value;
+    if (a->kind.tag == KOOPA_RVT_LOAD && b->kind.tag == KOOPA_RVT_LOAD)
+        return a->kind.data.load.src == b->kind.data.load.src && a->kind.data.load.src->kind.tag == KOOPA_RVT_ALLOC;
+    if (a->kind.tag == KOOPA_RVT_BINARY && b->kind.tag == KOOPA_RVT_BINARY)
+        return a->kind.data.binary.op == b->kind.data.binary.op
+            && Same_expr(a->kind.data.binary.lhs, b->kind.data.binary.lhs) && Same_expr(a->kind.data.binary.rhs, b->kind.data.binary.rhs);
+    if (a->kind.tag == KOOPA_RVT_GET_ELEM_PTR && b->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+        return Same_expr(a->kind.data.get_elem_ptr.src, b->kind.data.get_elem_ptr.src)
+            && Same_expr(a->kind.data.get_elem_ptr.index, b->kind.data.get_elem_ptr.index);
+    if (a->kind.tag == KOOPA_RVT_GET_PTR && b->kind.tag == KOOPA_RVT_GET_PTR)
+        return Same_expr(a->kind.data.get_ptr.src, b->kind.data.get_ptr.src)
+            && Same_expr(a->kind.data.get_ptr.index, b->kind.data.get_ptr.index);
+    return false;
+}
+
+// 外层循环中不属于内层循环的部分只有循环控制：对两个归纳变量的load、store，算术运算和跳转
+static bool Is_control_only(const Loop_nest &nest)
+{
+    koopa_raw_value_t i = nest.outer_info.var, j = nest.inner_info.var;
+    for (Block_IR *block : nest.outer->blocks)
+    {
+        if (nest.inner->Contains(block))
+            continue;
+        for (auto inst : block->insts)
+            switch (inst->kind.tag)
+            {
+            case KOOPA_RVT_LOAD:
+                if (!Is_load_of(inst, i) && !Is_load_of(inst, j))
+                    return false;
+                break;
+            case KOOPA_RVT_STORE:
+                if (inst->kind.data.store.dest != i && inst->kind.data.store.dest != j)
+                    return false;
+                break;
+            case KOOPA_RVT_BINARY:
+            case KOOPA_RVT_BRANCH:
+            case KOOPA_RVT_JUMP:
+                break;
+            default:
+                return false;
+            }
+    }
+    return true;
+}
+
+// 外层循环体开头给内层归纳变量赋初值，然后判断是否进入内层循环（while旋转后的入口判断）
+// 交换后这个判断一定成立，可以直接去掉
+static bool Find_inner_init(Func_IR *func, Loop_nest &nest)
+{
+    Block_IR *head = nest.outer->header;
+    koopa_raw_value_t j = nest.inner_info.var;
+    koopa_raw_value_t term = head->Terminator();
+    if (term->kind.tag != KOOPA_RVT_BRANCH || func->block_map[term->kind.data.branch.false_bb] != nest.outer_info.latch)
+        return false;
+    koopa_raw_value_t cond = term->kind.data.branch.cond;
+    if (cond->kind.tag != KOOPA_RVT_BINARY || func->def_block[cond] != head)
+        return false;
+
+    // 判断的是 j op bound，且与内层循环latch中的比较相同
+    auto &cmp = cond->kind.data.binary;
+    koopa_raw_value_t load = nest.inner_info.iv_left ? cmp.lhs : cmp.rhs;
+    koopa_raw_value_t bound = nest.inner_info.iv_left ? cmp.rhs : cmp.lhs;
+    if (cmp.op != nest.inner_info.cond->kind.data.binary.op || !Is_load_of(load, j) || !Same_expr(bound, nest.inner_info.bound))
+        return false;
+
+    // load之前的最后一次store给出初值
+    bool found = false;
+    for (auto inst : head->insts)
+    {
+        if (inst == load)
+            break;
+        if (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.dest == j)
+        {
+            if (!Is_const(inst->kind.data.store.value))
+                return false;
+            nest.inner_init = inst->kind.data.store.value->kind.data.integer.value;
+            found = true;
+        }
+    }
+    nest.inner_init_block = head;
+    return found;
+}
+
+// 识别两层完美嵌套的计数循环，两层的初值和边界都是常数且都至少执行一次
+static bool Analyze_nest(Func_IR *func, Loop *outer, Loop_nest &nest)
+{
+    if (outer->children.size() != 1)
+        return false;
+    Loop *inner = outer->children[0];
+    if (!inner->children.empty())
+        return false;
+    nest.outer = outer;
+    nest.inner = inner;
+    if (!Analyze_loop(func, outer, nest.outer_info) || !Analyze_loop(func, inner, nest.inner_info))
+        return false;
+    if (nest.inner_info.exit != nest.outer_info.latch || nest.outer_info.latch == nest.inner_info.latch)
+        return false;
+    if (!Is_const(nest.outer_info.bound) || !Is_const(nest.inner_info.bound))
+        return false;
+    if (nest.outer_info.var->kind.tag != KOOPA_RVT_ALLOC || nest.inner_info.var->kind.tag != KOOPA_RVT_ALLOC)
+        return false;
+    if (!Is_control_only(nest) || !Find_inner_init(func, nest))
+        return false;
+
+    Insert_preheader(func, outer);
+    if (!Find_init(outer, nest.outer_info.var, nest.outer_init))
+        return false;
+    return Enters(nest.outer_info, nest.outer_init) && Enters(nest.inner_info, nest.inner_init);
+}
+
+// 内层循环中的s = s + x：加法满足交换律和结合律（溢出时按2^32取模也一样），迭代顺序改变后结果不变
+static bool Is_reduction(const Loop_nest &nest, koopa_raw_value_t store)
+{
+    koopa_raw_value_t var = store->kind.data.store.dest;
+    koopa_raw_value_t value = store->kind.data.store.value;
+    if (var->kind.tag != KOOPA_RVT_ALLOC && var->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
+        return false;
+    if (value->kind.tag != KOOPA_RVT_BINARY || value->kind.data.binary.op != KOOPA_RBO_ADD)
+        return false;
+    auto &add = value->kind.data.binary;
+    koopa_raw_value_t load = Is_load_of(add.lhs, var) ? add.lhs : add.rhs;
+    koopa_raw_value_t other = load == add.lhs ? add.rhs : add.lhs;
+    if (!Is_load_of(load, var) || Uses_var(other, var))
+        return false;
+
+    // 循环中对var只有这一次load和store
+    for (Block_IR *block : nest.inner->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_STORE && inst != store && Alias(inst->kind.data.store.dest, var) != NO_ALIAS)
+                return false;
+            if (inst->kind.tag == KOOPA_RVT_LOAD && inst != load && Alias(inst->kind.data.load.src, var) != NO_ALIAS)
+                return false;
+        }
+    return true;
+}
+
+// 下标是否是var的单射仿射函数：var、var ± c、c - var、var * c，c为非0常数
+static bool Is_affine_of(koopa_raw_value_t index, koopa_raw_value_t var)
+{
+    if (Is_load_of(index, var))
+        return true;
+    if (index->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    auto &bin = index->kind.data.binary;
+    switch (bin.op)
+    {
+    case KOOPA_RBO_ADD:
+    case KOOPA_RBO_SUB:
+        return (Is_affine_of(bin.lhs, var) && Is_const(bin.rhs)) || (Is_const(bin.lhs) && Is_affine_of(bin.rhs, var));
+    case KOOPA_RBO_MUL:
+        if (Is_const(bin.rhs))
+            return bin.rhs->kind.data.integer.value != 0 && Is_affine_of(bin.lhs, var);
+        return Is_const(bin.lhs) && bin.lhs->kind.data.integer.value != 0 && Is_affine_of(bin.rhs, var);
+    default:
+        return false;
+    }
+}
+
+// 表达式在内层循环中是否不变：只由常数和对written以外的变量的load组成
+static bool Is_invariant(koopa_raw_value_t value, const set<koopa_raw_value_t> &written)
+{
+    if (Is_const(value))
+        return true;
+    if (value->kind.tag == KOOPA_RVT_LOAD)
+    {
+        koopa_raw_value_t src = value->kind.data.load.src;
+        return (src->kind.tag == KOOPA_RVT_ALLOC || src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) && !written.count(src);
+    }
+    if (value->kind.tag == KOOPA_RVT_BINARY)
+        return Is_invariant(value->kind.data.binary.lhs, written) && Is_invariant(value->kind.data.binary.rhs, written);
+    return false;
+}
+
+// store的地址是否是(i, j)的单射：至少一层下标是i的仿射函数、一层是j的仿射函数，其余各层和基地址都不变
+// 例如a[i][j]、a[j + 1][i]；a[0][0]、a[i + j][0]在不同的迭代中会写同一个元素，不满足
+static bool Is_injective(const Loop_nest &nest, koopa_raw_value_t ptr, const set<koopa_raw_value_t> &written)
+{
+    koopa_raw_value_t i = nest.outer_info.var, j = nest.inner_info.var;
+    bool uses_i = false, uses_j = false;
+    while (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ptr->kind.tag == KOOPA_RVT_GET_PTR)
+    {
+        koopa_raw_value_t index;
+        if (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+            index = ptr->kind.data.get_elem_ptr.index, ptr = ptr->kind.data.get_elem_ptr.src;
+        else index = ptr->kind.data.get_ptr.index, ptr = ptr->kind.data.get_ptr.src;
+        if (Is_affine_of(index, i))
+            uses_i = true;
+        else if (Is_affine_of(index, j))
+            uses_j = true;
+        else if (!Is_invariant(index, written))
+            return false;
+    }
+    if (ptr->kind.tag != KOOPA_RVT_ALLOC && ptr->kind.tag != KOOPA_RVT_GLOBAL_ALLOC && !Is_invariant(ptr, written))
+        return false;
+    return uses_i && uses_j;
+}
+
+// 交换是否合法：内层循环没有函数调用；对标量的写入只有内层归纳变量的更新和求和；
+// 数组store的地址是(i, j)的单射，可能与它重叠的访问的下标必须与它完全相同（依赖距离为(0,0)），
+// 这样每次迭代只访问自己的元素，改变迭代顺序不影响结果
+static bool Is_legal(const Loop_nest &nest)
+{
+    vector<koopa_raw_value_t> stores, accesses;
+    set<koopa_raw_value_t> written = {nest.outer_info.var, nest.inner_info.var};
+    for (Block_IR *block : nest.inner->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                return false;
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                koopa_raw_value_t dest = inst->kind.data.store.dest;
+                if (inst == nest.inner_info.store)
+                    continue;
+                if (dest->kind.tag == KOOPA_RVT_ALLOC || dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                {
+                    if (!Is_reduction(nest, inst))
+                        return false;
+                    written.insert(dest);
+                    continue;
+                }
+                stores.push_back(dest);
+                accesses.push_back(dest);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_LOAD)
+                accesses.push_back(inst->kind.data.load.src);
+        }
+
+    for (auto dest : stores)
+        if (!Is_injective(nest, dest, written))
+            return false;
+    for (auto dest : stores)
+        for (auto ptr : accesses)
+            if (Alias(dest, ptr) != NO_ALIAS && !Same_expr(dest, ptr))
+                return false;
+
+    // 内层归纳变量的更新必须在本次迭代的所有访问之后
+    Block_IR *latch = nest.inner_info.latch;
+    auto pos = find(latch->insts.begin(), latch->insts.end(), nest.inner_info.store);
+    for (auto it = pos + 1; it != latch->insts.end(); ++it)
+        if ((*it)->kind.tag == KOOPA_RVT_STORE || ((*it)->kind.tag == KOOPA_RVT_LOAD && !Is_load_of(*it, nest.inner_info.var)))
+            return false;
+    return true;
+}
+
+// 交换是否有利：按行优先存储，最后一维的下标随内层循环变化时访问是连续的
+// 统计最后一维随外层变量变化、而前面的维随内层变量变化的访问是否多于连续的访问
+static bool Is_profitable(const Loop_nest &nest)
+{
+    koopa_raw_value_t i = nest.outer_info.var, j = nest.inner_info.var;
+    int strided = 0, contiguous = 0;
+    for (Block_IR *block : nest.inner->blocks)
+        for (auto inst : block->insts)
+        {
+            koopa_raw_value_t ptr = nullptr;
+            if (inst->kind.tag == KOOPA_RVT_LOAD)
+                ptr = inst->kind.data.load.src;
+            else if (inst->kind.tag == KOOPA_RVT_STORE)
+                ptr = inst->kind.data.store.dest;
+            if (ptr == nullptr || ptr->kind.tag != KOOPA_RVT_GET_ELEM_PTR)
+                continue;
+
+            koopa_raw_value_t last = ptr->kind.data.get_elem_ptr.index;
+            bool outer_dims_use_j = false;
+            for (koopa_raw_value_t p = ptr->kind.data.get_elem_ptr.src; p->kind.tag == KOOPA_RVT_GET_ELEM_PTR; p = p->kind.data.get_elem_ptr.src)
+                outer_dims_use_j = outer_dims_use_j || Uses_var(p->kind.data.get_elem_ptr.index, j);
+
+            if (Uses_var(last, j))
+                contiguous++;
+            else if (Uses_var(last, i) && outer_dims_use_j)
+                strided++;
+        }
+    return strided > contiguous;
+}
+
+// 在block末尾加入 var = var + step; br var op bound, true_block, false_block
+static void Append_step(Block_IR *block, const Counted_loop &info, Block_IR *true_block, Block_IR *false_block)
+{
+    koopa_raw_value_t old = New_load(info.var);
+    koopa_raw_value_t next = New_binary(KOOPA_RBO_ADD, old, New_integer(info.step));
+    koopa_raw_value_t load = New_load(info.var);
+    auto op = info.cond->kind.data.binary.op;
+    koopa_raw_value_t cond = info.iv_left ? New_binary(op, load, info.bound) : New_binary(op, info.bound, load);
+    block->insts.insert(block->insts.end(), {old, next, New_store(next, info.var), load, cond, New_branch(cond, true_block, false_block)});
+}
+
+static void Remove_inst(Block_IR *block, koopa_raw_value_t inst)
+{
+    block->insts.erase(find(block->insts.begin(), block->insts.end(), inst));
+}
+
+// 交换两层循环的控制：外层循环改为控制原来内层的变量j，内层循环改为控制i，循环体不变
+// 两层都至少执行一次且初值、边界都是常数，所以循环结束后i、j的值与交换前相同
+static void Interchange(Func_IR *func, Loop_nest &nest)
+{
+    Counted_loop &outer = nest.outer_info, &inner = nest.inner_info;
+    Block_IR *head = nest.inner_init_block;
+    Block_IR *inner_entry = func->block_map[head->Terminator()->kind.data.branch.true_bb];
+    Block_IR *outer_latch = outer.latch, *inner_latch = inner.latch;
+
+    // 进入循环前给j赋初值
+    Block_IR *preheader = nest.outer->preheader;
+    preheader->insts.insert(preheader->insts.end() - 1, New_store(New_integer(nest.inner_init), inner.var));
+
+    // 外层循环体开头改为给i赋初值，直接进入内层循环
+    for (auto inst : vector<koopa_raw_value_t>(head->insts))
+        if (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.dest == inner.var)
+            Remove_inst(head, inst);
+    head->insts.pop_back();
+    head->insts.push_back(New_store(New_integer(nest.outer_init), outer.var));
+    head->insts.push_back(New_jump(inner_entry));
+
+    // 内层latch改为更新i，外层latch改为更新j
+    Remove_inst(inner_latch, inner.store);
+    inner_latch->insts.pop_back();
+    Append_step(inner_latch, outer, nest.inner->header, outer_latch);
+    Remove_inst(outer_latch, outer.store);
+    outer_latch->insts.pop_back();
+    Append_step(outer_latch, inner, nest.outer->header, outer.exit);
+
+    Remove_unused(func);
+    Build_CFG(func);
+}
+
+// 循环交换（loop interchange）
+// 对按列遍历二维数组的两层完美嵌套循环，检查依赖后交换内外层，使内层循环沿行连续访问内存
+// 分块（tiling）只在有cache的处理器上才有收益，而增加的循环控制指令在任何处理器上都要执行，暂不实现
+void Interchange_loops(Func_IR *func)
+{
+    Build_CFG(func);
+    Find_loops(func);
+
+    for (Loop *loop : func->loops)
+    {
+        Build_CFG(func);
+        Loop_nest nest;
+        if (Analyze_nest(func, loop, nest) && Is_legal(nest) && Is_profitable(nest))
+            Interchange(func, nest);
+    }
+}
@@ -0,0 +1,348 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#define SPECIALIZE_LIMIT 300 // 可以被复制出特化版本的函数的最大指令数
+#define SPECIALIZE_MAX_CLONES 4 // 每个函数最多的特化版本数
+#define SPECIALIZE_MIN_GAIN 4 // 特化后至少要被常量折叠掉的指令数
+#define BRANCH_GAIN 4 // 条件变为常数的分支按这么多条指令计算
+#define LOOP_WEIGHT 4 // 循环中被折叠的指令按这么多倍计算
+
+// 调用时为常数的参数：参数下标及其值
+typedef vector<pair<int, int>> Const_args;
+
+static int Func_size(Func_IR *func)
+{
+    int size = 0;
+    for (Block_IR *block : func->blocks)
+        size += block->insts.size();
+    return size;
+}
+
+// skip中的参数不作为特化的依据
+static Const_args Key_of(koopa_raw_value_t call, const set<int> &skip)
+{
+    Const_args key;
+    auto &args = call->kind.data.call.args;
+    for (size_t i = 0; i < args.len; i++)
+    {
+        koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        if (Is_const(arg) && !skip.count(i))
+            key.push_back(make_pair(i, arg->kind.data.integer.value));
+    }
+    return key;
+}
+
+// 计算两个常数的运算结果，不能折叠（除数为0或溢出）时返回false
+static bool Eval(koopa_raw_binary_op_t op, int lhs, int rhs, int &result)
+{
+    unsigned l = lhs, r = rhs;
+    switch (op)
+    {
+    case KOOPA_RBO_NOT_EQ: result = lhs != rhs; break;
+    case KOOPA_RBO_EQ: result = lhs == rhs; break;
+    case KOOPA_RBO_GT: result = lhs > rhs; break;
+    case KOOPA_RBO_LT: result = lhs < rhs; break;
+    case KOOPA_RBO_GE: result = lhs >= rhs; break;
+    case KOOPA_RBO_LE: result = lhs <= rhs; break;
+    case KOOPA_RBO_ADD: result = l + r; break;
+    case KOOPA_RBO_SUB: result = l - r; break;
+    case KOOPA_RBO_MUL: result = l * r; break;
+    case KOOPA_RBO_AND: result = lhs & rhs; break;
+    case KOOPA_RBO_OR: result = lhs | rhs; break;
+    case KOOPA_RBO_XOR: result = lhs ^ rhs; break;
+    case KOOPA_RBO_SHL: result = l << (r & 31); break;
+    case KOOPA_RBO_SHR: result = l >> (r & 31); break;
+    case KOOPA_RBO_SAR: result = lhs >> (r & 31); break;
+    case KOOPA_RBO_DIV:
+    case KOOPA_RBO_MOD:
+        if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+            return false;
+        result = op == KOOPA_RBO_DIV ? lhs / rhs : lhs % rhs;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// 函数内的常量传播：只被存入同一个常数的局部变量的load替换为该常数，两个操作数都是常数的运算直接求值
+// 返回被折叠的指令数作为收益的估计，条件变为常数的分支按BRANCH_GAIN计算，循环中的按LOOP_WEIGHT倍计算
+// 分支本身由之后的DCE删除
+static int Propagate_constants(Func_IR *func)
+{
+    int gain = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        Build_CFG(func);
+        Find_loops(func);
+        set<Block_IR *> in_loop;
+        for (Loop *loop : func->loops)
+            in_loop.insert(loop->blocks.begin(), loop->blocks.end());
+
+        // 局部变量中一定存放的常数
+        map<koopa_raw_value_t, int> const_of;
+        set<koopa_raw_value_t> vars, varying;
+        for (auto var : Local_scalars(func))
+            vars.insert(var);
+        for (Block_IR *block : func->blocks)
+            for (auto inst : block->insts)
+            {
+                if (inst->kind.tag != KOOPA_RVT_STORE || !vars.count(inst->kind.data.store.dest))
+                    continue;
+                koopa_raw_value_t var = inst->kind.data.store.dest, value = inst->kind.data.store.value;
+                if (!Is_const(value) || (const_of.count(var) && const_of[var] != value->kind.data.integer.value))
+                    varying.insert(var);
+                else const_of[var] = value->kind.data.integer.value;
+            }
+        for (auto var : varying)
+            const_of.erase(var);
+
+        // 按逆后序遍历，定义先于使用被处理
+        map<koopa_raw_value_t, koopa_raw_value_t> replace;
+        for (Block_IR *block : func->rpo_order)
+        {
+            int weight = in_loop.count(block) ? LOOP_WEIGHT : 1;
+            vector<koopa_raw_value_t> remain;
+            for (auto inst : block->insts)
+            {
+                bool was_const = inst->kind.tag == KOOPA_RVT_BRANCH && Is_const(inst->kind.data.branch.cond);
+                for (auto op : Operands(inst))
+                    if (replace.count(*op))
+                        *op = replace[*op];
+
+                int result;
+                if (inst->kind.tag == KOOPA_RVT_LOAD)
+                {
+                    koopa_raw_value_t src = inst->kind.data.load.src;
+                    if (const_of.count(src))
+                    {
+                        replace[inst] = New_integer(const_of[src]);
+                        gain += weight;
+                        continue;
+                    }
+                }
+                else if (inst->kind.tag == KOOPA_RVT_BINARY)
+                {
+                    auto &binary = inst->kind.data.binary;
+                    if (Is_const(binary.lhs) && Is_const(binary.rhs) && Eval(binary.op, binary.lhs->kind.data.integer.value, binary.rhs->kind.data.integer.value, result))
+                    {
+                        replace[inst] = New_integer(result);
+                        gain += weight;
+                        continue;
+                    }
+                }
+                else if (inst->kind.tag == KOOPA_RVT_BRANCH && !was_const && Is_const(inst->kind.data.branch.cond))
+                    gain += BRANCH_GAIN * weight;
+                remain.push_back(inst);
+            }
+            block->insts = remain;
+        }
+
+        if (replace.empty())
+            break;
+        changed = true;
+        // 不可达的块中的使用
+        for (Block_IR *block : func->blocks)
+            for (auto inst : block->insts)
+                for (auto op : Operands(inst))
+                    if (replace.count(*op))
+                        *op = replace[*op];
+    }
+    return gain;
+}
+
+// 递归调用时会改变的参数：自身调用处的实参不是从存放该参数的局部变量中原样读出的值
+// 按这样的参数特化时，递归调用无法使用同一个特化版本
+static set<int> Recursion_varying(Func_IR *func)
+{
+    auto &params = func->func->params;
+    // 只存放某个参数的局部变量
+    map<koopa_raw_value_t, koopa_raw_value_t> param_of;
+    set<koopa_raw_value_t> other;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                koopa_raw_value_t var = inst->kind.data.store.dest, value = inst->kind.data.store.value;
+                if (value->kind.tag != KOOPA_RVT_FUNC_ARG_REF || (param_of.count(var) && param_of[var] != value))
+                    other.insert(var);
+                else param_of[var] = value;
+            }
+
+    set<int> varying;
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag != KOOPA_RVT_CALL || inst->kind.data.call.callee != func->func)
+                continue;
+            auto &args = inst->kind.data.call.args;
+            for (size_t i = 0; i < args.len; i++)
+            {
+                koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+                koopa_raw_value_t param = reinterpret_cast<koopa_raw_value_t>(params.buffer[i]);
+                bool same = arg == param;
+                if (arg->kind.tag == KOOPA_RVT_LOAD)
+                {
+                    koopa_raw_value_t var = arg->kind.data.load.src;
+                    same = param_of.count(var) && !other.count(var) && param_of[var] == param;
+                }
+                if (!same)
+                    varying.insert(i);
+            }
+        }
+    return varying;
+}
+
+// 复制func，key中的参数替换为常数并从参数列表中去掉
+static Func_IR *Clone_func(Func_IR *func, const Const_args &key, int num)
+{
+    auto &params = func->func->params;
+    map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    vector<const void *> new_params, param_types;
+    size_t k = 0;
+    for (size_t i = 0; i < params.len; i++)
+    {
+        koopa_raw_value_t param = reinterpret_cast<koopa_raw_value_t>(params.buffer[i]);
+        if (k < key.size() && key[k].first == (int)i)
+        {
+            value_map[param] = New_integer(key[k++].second);
+            continue;
+        }
+        koopa_raw_value_data_t *arg = New_value(param->ty, KOOPA_RVT_FUNC_ARG_REF);
+        arg->name = param->name;
+        arg->kind.data.func_arg_ref.index = new_params.size();
+        value_map[param] = arg;
+        new_params.push_back(arg);
+        param_types.push_back(param->ty);
+    }
+
+    koopa_raw_type_kind_t *ty = new koopa_raw_type_kind_t;
+    ty->tag = KOOPA_RTT_FUNCTION;
+    ty->data.function.params = Make_slice(param_types, KOOPA_RSIK_TYPE);
+    ty->data.function.ret = func->func->ty->data.function.ret;
+
+    koopa_raw_function_data_t *data = new koopa_raw_function_data_t;
+    string name = string(func->func->name) + "_spec_" + to_string(num);
+    char *buf = new char [name.size() + 1];
+    strcpy(buf, name.c_str());
+    data->ty = ty;
+    data->name = buf;
+    data->params = Make_slice(new_params, KOOPA_RSIK_VALUE);
+    data->bbs = Make_slice(vector<const void *>(), KOOPA_RSIK_BASIC_BLOCK);
+
+    Func_IR *clone = new Func_IR(data);
+    clone->blocks = Clone_blocks(func->blocks, value_map);
+    return clone;
+}
+
+// 把调用改为调用特化版本，去掉已经固定为常数的实参
+static void Retarget(koopa_raw_value_t call, Func_IR *clone, const Const_args &key)
+{
+    auto &args = Mut(call)->kind.data.call.args;
+    vector<const void *> remain;
+    size_t k = 0;
+    for (size_t i = 0; i < args.len; i++)
+    {
+        if (k < key.size() && key[k].first == (int)i)
+        {
+            k++;
+            continue;
+        }
+        remain.push_back(args.buffer[i]);
+    }
+    args = Make_slice(remain, KOOPA_RSIK_VALUE);
+    Mut(call)->kind.data.call.callee = clone->func;
+}
+
+// 程序中所有对func的调用
+static vector<koopa_raw_value_t> Call_sites(Program_IR *prog, Func_IR *func)
+{
+    vector<koopa_raw_value_t> sites;
+    for (Func_IR *caller : prog->funcs)
+        for (Block_IR *block : caller->blocks)
+            for (auto inst : block->insts)
+                if (inst->kind.tag == KOOPA_RVT_CALL && inst->kind.data.call.callee == func->func)
+                    sites.push_back(inst);
+    return sites;
+}
+
+// 为传入相同常数的一组调用生成特化版本，折叠掉的指令太少时放弃
+static void Specialize(Program_IR *prog, Func_IR *func, const vector<koopa_raw_value_t> &sites, const set<int> &skip)
+{
+    vector<Const_args> keys;
+    for (auto call : sites)
+    {
+        Const_args key = Key_of(call, skip);
+        if (!key.empty() && find(keys.begin(), keys.end(), key) == keys.end())
+            keys.push_back(key);
+    }
+    if (keys.size() > SPECIALIZE_MAX_CLONES)
+        keys.resize(SPECIALIZE_MAX_CLONES);
+
+    int num = 0;
+    for (auto &key : keys)
+    {
+        Func_IR *clone = Clone_func(func, key, num);
+        if (Propagate_constants(clone) < SPECIALIZE_MIN_GAIN)
+            continue;
+        num++;
+        prog->funcs.push_back(clone);
+
+        // 原函数中的递归调用也在sites中；特化版本中复制出的递归调用需要单独处理
+        // 已经改为调用其他特化版本的调用参数列表变短了，下标不再对应原函数的参数，不能再次改写
+        for (auto call : sites)
+            if (call->kind.data.call.callee == func->func && Key_of(call, skip) == key)
+                Retarget(call, clone, key);
+        for (Block_IR *block : clone->blocks)
+            for (auto inst : block->insts)
+                if (inst->kind.tag == KOOPA_RVT_CALL && inst->kind.data.call.callee == func->func && Key_of(inst, skip) == key)
+                    Retarget(inst, clone, key);
+    }
+}
+
+// 过程间常量传播与函数特化（interprocedural constant propagation / function specialization）
+// 所有调用处都传入同一个常数的参数直接替换为该常数；否则为传入相同常数的一组调用复制出特化版本，
+// 特化版本中该参数被替换为常数并从参数列表中去掉。之后在函数内传播常数，使循环边界、分支条件等被折叠
+void Ipcp(Program_IR *prog)
+{
+    vector<Func_IR *> funcs = prog->funcs;
+    for (Func_IR *func : funcs)
+    {
+        if (func->Is_decl() || string(func->func->name) == "@main")
+            continue;
+        vector<koopa_raw_value_t> sites = Call_sites(prog, func);
+        if (sites.empty())
+            continue;
+
+        // 所有调用处都传入同一个常数的参数
+        set<int> fixed;
+        auto &params = func->func->params;
+        for (auto &item : Key_of(sites[0], fixed))
+        {
+            bool same = true;
+            for (auto call : sites)
+            {
+                koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(call->kind.data.call.args.buffer[item.first]);
+                if (!Is_const(arg) || arg->kind.data.integer.value != item.second)
+                    same = false;
+            }
+            if (same)
+            {
+                Replace_uses(func, reinterpret_cast<koopa_raw_value_t>(params.buffer[item.first]), New_integer(item.second));
+                fixed.insert(item.first);
+            }
+        }
+        if (!fixed.empty())
+            Propagate_constants(func);
+
+        // 已经被替换为常数的参数和递归中会改变的参数不再作为特化的依据
+        set<int> skip = Recursion_varying(func);
+        skip.insert(fixed.begin(), fixed.end());
+        if (Func_size(func) <= SPECIALIZE_LIMIT)
+            Specialize(prog, func, sites, skip);
+    }
+}
@@ -0,0 +1,340 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+#include <sstream>
+
+// 后端中各种指令大致的代价（翻译后的指令条数），用于判断强度削弱是否有收益
+#define ADDR_COST 5 // 一条getelemptr/getptr
+#define PTR_UPDATE_COST 7 // 更新一次指针归纳变量：load、getptr、store
+
+// block中第pos条指令是对局部变量的store，判断它是否形如 store (add (load var), c), var
+// 要求load与store在同一个块中，且两者之间var没有被修改。若是，step为增量c
+static bool Is_increment(Block_IR *block, size_t pos, int &step)
+{
+    koopa_raw_value_t store = block->insts[pos];
+    koopa_raw_value_t var = store->kind.data.store.dest;
+    koopa_raw_value_t value = store->kind.data.store.value;
+    if (value->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+
+    auto &binary = value->kind.data.binary;
+    koopa_raw_value_t load, c;
+    if ((binary.op == KOOPA_RBO_ADD || binary.op == KOOPA_RBO_SUB) && Is_const(binary.rhs))
+        load = binary.lhs, c = binary.rhs;
+    else if (binary.op == KOOPA_RBO_ADD && Is_const(binary.lhs))
+        load = binary.rhs, c = binary.lhs;
+    else return false;
+    if (load->kind.tag != KOOPA_RVT_LOAD || load->kind.data.load.src != var)
+        return false;
+
+    for (size_t i = pos; i-- > 0; )
+    {
+        koopa_raw_value_t inst = block->insts[i];
+        if (inst == load)
+        {
+            step = c->kind.data.integer.value;
+            if (binary.op == KOOPA_RBO_SUB)
+                step = -step;
+            return true;
+        }
+        if (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.dest == var)
+            return false;
+    }
+    return false;
+}
+
+// 寻找循环中的基本归纳变量
+// 只考虑int类型的局部变量：它们的地址不会逃逸，只能被循环中的store修改
+vector<Induction_var> Find_induction_vars(Func_IR *func, Loop *loop)
+{
+    vector<Induction_var> ivs;
+    map<koopa_raw_value_t, size_t> index;
+    set<koopa_raw_value_t> bad;
+
+    for (Block_IR *block : func->rpo_order)
+    {
+        if (!loop->Contains(block))
+            continue;
+        for (size_t i = 0; i < block->insts.size(); i++)
+        {
+            koopa_raw_value_t inst = block->insts[i];
+            if (inst->kind.tag != KOOPA_RVT_STORE)
+                continue;
+            koopa_raw_value_t var = inst->kind.data.store.dest;
+            if (var->kind.tag != KOOPA_RVT_ALLOC || var->ty->data.pointer.base->tag != KOOPA_RTT_INT32)
+                continue;
+
+            int step;
+            if (!Is_increment(block, i, step))
+            {
+                bad.insert(var);
+                continue;
+            }
+            if (!index.count(var))
+            {
+                index[var] = ivs.size();
+                ivs.push_back(Induction_var());
+                ivs.back().var = var;
+            }
+            ivs[index[var]].steps[inst] = step;
+        }
+    }
+
+    vector<Induction_var> result;
+    for (auto &iv : ivs)
+        if (!bad.count(iv.var))
+            result.push_back(iv);
+    return result;
+}
+
+// 循环中关于归纳变量线性变化的地址 &base[iv][inv1][inv2]...
+struct Linear_addr
+{
+    koopa_raw_value_t iv_load; // 作为下标的 load iv
+    koopa_raw_value_t var; // 归纳变量
+    vector<koopa_raw_value_t> chain; // 从以iv为下标的getelemptr/getptr开始，逐层向外的地址计算
+};
+
+// 地址计算指令的基地址和下标
+static koopa_raw_value_t Addr_src(koopa_raw_value_t addr)
+{
+    if (addr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+        return addr->kind.data.get_elem_ptr.src;
+    return addr->kind.data.get_ptr.src;
+}
+
+static koopa_raw_value_t Addr_index(koopa_raw_value_t addr)
+{
+    if (addr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+        return addr->kind.data.get_elem_ptr.index;
+    return addr->kind.data.get_ptr.index;
+}
+
+// 复制一条地址计算指令，替换其基地址和下标
+static koopa_raw_value_t Clone_addr(koopa_raw_value_t addr, koopa_raw_value_t src, koopa_raw_value_t index)
+{
+    koopa_raw_value_data_t *clone = New_value(addr->ty, addr->kind.tag);
+    if (addr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+    {
+        clone->kind.data.get_elem_ptr.src = src;
+        clone->kind.data.get_elem_ptr.index = index;
+    }
+    else
+    {
+        clone->kind.data.get_ptr.src = src;
+        clone->kind.data.get_ptr.index = index;
+    }
+    return clone;
+}
+
+static bool Is_invariant(Func_IR *func, Loop *loop, koopa_raw_value_t value)
+{
+    auto it = func->def_block.find(value);
+    return it == func->def_block.end() || !loop->Contains(it->second);
+}
+
+// 计算循环中每个地址是否关于某个归纳变量线性变化
+static map<koopa_raw_value_t, Linear_addr> Find_linear_addrs(Func_IR *func, Loop *loop, const set<koopa_raw_value_t> &iv_vars)
+{
+    map<koopa_raw_value_t, Linear_addr> linear;
+    for (Block_IR *block : func->rpo_order)
+    {
+        if (!loop->Contains(block))
+            continue;
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag != KOOPA_RVT_GET_ELEM_PTR && inst->kind.tag != KOOPA_RVT_GET_PTR)
+                continue;
+            koopa_raw_value_t src = Addr_src(inst), index = Addr_index(inst);
+
+            // &base[iv]，base在循环中不变
+            if (index->kind.tag == KOOPA_RVT_LOAD && iv_vars.count(index->kind.data.load.src) && Is_invariant(func, loop, src))
+            {
+                Linear_addr addr;
+                addr.iv_load = index;
+                addr.var = index->kind.data.load.src;
+                addr.chain.push_back(inst);
+                linear[inst] = addr;
+            }
+            // &linear[inv]
+            else if (linear.count(src) && Is_invariant(func, loop, index))
+            {
+                Linear_addr addr = linear[src];
+                addr.chain.push_back(inst);
+                linear[inst] = addr;
+            }
+        }
+    }
+    return linear;
+}
+
+// 用于判断两个地址的计算方式是否相同。常数每次出现都是不同的value，按值比较
+static string Value_key(koopa_raw_value_t value)
+{
+    if (Is_const(value))
+        return "#" + to_string(value->kind.data.integer.value);
+    ostringstream os;
+    os << value;
+    return os.str();
+}
+
+static string Addr_key(const Linear_addr &addr)
+{
+    string key = Value_key(addr.var) + " " + Value_key(Addr_src(addr.chain[0]));
+    for (size_t i = 0; i < addr.chain.size(); i++)
+    {
+        key += " " + to_string(addr.chain[i]->kind.tag);
+        if (i > 0)
+            key += ":" + Value_key(Addr_index(addr.chain[i]));
+    }
+    return key;
+}
+
+// 对一个循环做强度削弱：
+// 把 &base[i][inv]... 这样随归纳变量i线性变化的地址改为一个指针变量p，
+// 在preheader中初始化p，每次i = i + c之后令p = p + c * stride，
+// 原来每次迭代的乘法和加法变为一次load
+static void Reduce_loop(Func_IR *func, Loop *loop)
+{
+    vector<Induction_var> ivs = Find_induction_vars(func, loop);
+    if (ivs.empty())
+        return;
+
+    map<koopa_raw_value_t, Induction_var *> iv_of;
+    set<koopa_raw_value_t> iv_vars;
+    for (auto &iv : ivs)
+    {
+        iv_of[iv.var] = &iv;
+        iv_vars.insert(iv.var);
+    }
+
+    map<koopa_raw_value_t, Linear_addr> linear = Find_linear_addrs(func, loop, iv_vars);
+
+    // 只处理最外层的地址：它不再作为其他线性地址的基地址
+    set<koopa_raw_value_t> inner;
+    for (auto &item : linear)
+        for (size_t i = 0; i + 1 < item.second.chain.size(); i++)
+            inner.insert(item.second.chain[i]);
+
+    // 按计算方式分组，同一组共用一个指针变量
+    map<string, vector<Linear_addr>> groups;
+    vector<string> order;
+    for (Block_IR *block : func->rpo_order)
+    {
+        if (!loop->Contains(block))
+            continue;
+        for (auto inst : block->insts)
+        {
+            if (!linear.count(inst) || inner.count(inst))
+                continue;
+            string key = Addr_key(linear[inst]);
+            if (!groups.count(key))
+                order.push_back(key);
+            groups[key].push_back(linear[inst]);
+        }
+    }
+
+    Block_IR *preheader = nullptr;
+    map<koopa_raw_value_t, vector<koopa_raw_value_t>> insert_after;
+    vector<pair<koopa_raw_value_t, koopa_raw_value_t>> replaced;
+    for (auto &key : order)
+    {
+        vector<Linear_addr> &members = groups[key];
+        Linear_addr &first = members[0];
+        Induction_var *iv = iv_of[first.var];
+
+        int saving = 0;
+        for (auto &addr : members)
+            saving += ADDR_COST * addr.chain.size();
+        if (saving <= PTR_UPDATE_COST * (int)iv->steps.size())
+            continue;
+
+        // i每增加1，地址增加的单元数
+        koopa_raw_value_t head = first.chain[0], tail = first.chain.back();
+        int elem_size = Type_size(tail->ty->data.pointer.base);
+        int stride = Type_size(head->ty->data.pointer.base);
+        if (elem_size == 0 || stride % elem_size != 0)
+            continue;
+        stride /= elem_size;
+
+        if (preheader == nullptr)
+            preheader = Insert_preheader(func, loop);
+
+        koopa_raw_value_t ptr = New_alloc(tail->ty, "iv_ptr");
+        func->blocks[0]->insts.insert(func->blocks[0]->insts.begin(), ptr);
+        func->def_block[ptr] = func->blocks[0];
+
+        // 在preheader中初始化指针
+        vector<koopa_raw_value_t> init;
+        koopa_raw_value_t addr = New_load(first.var);
+        init.push_back(addr);
+        for (size_t i = 0; i < first.chain.size(); i++)
+        {
+            koopa_raw_value_t index = (i == 0) ? init[0] : Addr_index(first.chain[i]);
+            koopa_raw_value_t src = (i == 0) ? Addr_src(head) : addr;
+            addr = Clone_addr(first.chain[i], src, index);
+            init.push_back(addr);
+        }
+        init.push_back(New_store(addr, ptr));
+        preheader->insts.insert(preheader->insts.end() - 1, init.begin(), init.end());
+        for (auto inst : init)
+            func->def_block[inst] = preheader;
+
+        // i每次改变后同步更新指针
+        for (auto &step : iv->steps)
+        {
+            koopa_raw_value_t load = New_load(ptr);
+            koopa_raw_value_data_t *next = New_value(tail->ty, KOOPA_RVT_GET_PTR);
+            next->kind.data.get_ptr.src = load;
+            next->kind.data.get_ptr.index = New_integer(step.second * stride);
+            auto &after = insert_after[step.first];
+            after.push_back(load);
+            after.push_back(next);
+            after.push_back(New_store(next, ptr));
+        }
+
+        // 原来的地址替换为在读取i之后立刻读出的指针
+        for (auto &member : members)
+        {
+            koopa_raw_value_t load = New_load(ptr);
+            insert_after[member.iv_load].push_back(load);
+            replaced.push_back(make_pair(member.chain.back(), load));
+        }
+    }
+
+    if (insert_after.empty())
+        return;
+
+    for (Block_IR *block : loop->blocks)
+    {
+        vector<koopa_raw_value_t> insts;
+        for (auto inst : block->insts)
+        {
+            insts.push_back(inst);
+            auto it = insert_after.find(inst);
+            if (it == insert_after.end())
+                continue;
+            for (auto added : it->second)
+            {
+                insts.push_back(added);
+                func->def_block[added] = block;
+            }
+        }
+        block->insts = insts;
+    }
+
+    for (auto &item : replaced)
+        Replace_uses(func, item.first, item.second);
+    Remove_unused(func);
+}
+
+// 归纳变量强度削弱（induction variable strength reduction）
+// 在LICM之后进行，此时地址中不变的部分已被外提，容易识别出线性变化的地址
+// Koopa IR中的比较运算只接受i32，所以循环的退出条件仍然比较i，不改写为指针比较
+void Strength_reduce(Func_IR *func)
+{
+    Build_CFG(func);
+    Find_loops(func);
+
+    for (Loop *loop : func->loops)
+        Reduce_loop(func, loop);
+}
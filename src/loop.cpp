@@ -0,0 +1,181 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 循环中的内存副作用
+struct Loop_effects
+{
+    vector<koopa_raw_value_t> store_dests; // 循环中所有store的地址
+    vector<koopa_raw_value_t> calls; // 循环中的函数调用
+};
+
+static Loop_effects Collect_effects(Loop *loop)
+{
+    Loop_effects effects;
+    for (Block_IR *block : loop->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+                effects.store_dests.push_back(inst->kind.data.store.dest);
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+                effects.calls.push_back(inst);
+        }
+    return effects;
+}
+
+// 操作数在循环中是否不变：常量、全局变量、函数参数、定义在循环外或已被外提的指令
+static bool Is_invariant_operand(Func_IR *func, Loop *loop, koopa_raw_value_t value)
+{
+    auto it = func->def_block.find(value);
+    if (it == func->def_block.end())
+        return true;
+    return !loop->Contains(it->second);
+}
+
+// ptr是否一定指向合法内存：由alloc或全局变量出发，且每一层下标都是范围内的常数
+static bool Is_dereferenceable(koopa_raw_value_t ptr)
+{
+    while (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+    {
+        auto &gep = ptr->kind.data.get_elem_ptr;
+        if (!Is_const(gep.index))
+            return false;
+        int index = gep.index->kind.data.integer.value;
+        auto array_ty = gep.src->ty->data.pointer.base;
+        if (index < 0 || index >= (int)array_ty->data.array.len)
+            return false;
+        ptr = gep.src;
+    }
+    return ptr->kind.tag == KOOPA_RVT_ALLOC || ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+// block是否在每次进入循环后一定会被执行：它支配所有离开循环的块
+static bool Is_guaranteed(Func_IR *func, Loop *loop, Block_IR *block)
+{
+    for (Block_IR *exiting : loop->Exiting_blocks())
+        if (!func->Dominates(block, exiting))
+            return false;
+    return true;
+}
+
+// load在循环中读到的值是否不变，且可以安全地提前到preheader执行
+static bool Can_hoist_load(Func_IR *func, Loop *loop, const Loop_effects &effects, koopa_raw_value_t load, Block_IR *block)
+{
+    koopa_raw_value_t src = load->kind.data.load.src;
+
+    // 函数调用可能修改全局变量和传入的数组
+    for (auto call : effects.calls)
+        if (Call_may_access(call, src))
+            return false;
+
+    // load的地址在循环中不变时才会被外提，store的地址中在循环里变化的部分与它不同，不会被误判为相同
+    for (auto dest : effects.store_dests)
+        if (Alias(src, dest) != NO_ALIAS)
+            return false;
+
+    return Is_dereferenceable(src) || Is_guaranteed(func, loop, block);
+}
+
+static bool Same_operand(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    if (Is_const(a) && Is_const(b))
+        return a->kind.data.integer.value == b->kind.data.integer.value;
+    return a == b;
+}
+
+// 两条外提的指令是否计算相同的值。外提的load读取的内存在循环中不会被修改，
+// 外提的指令都连续地放在preheader末尾，中间没有store，所以操作数相同的指令结果也相同
+static bool Same_inst(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    if (a->kind.tag != b->kind.tag)
+        return false;
+    if (a->kind.tag == KOOPA_RVT_BINARY && a->kind.data.binary.op != b->kind.data.binary.op)
+        return false;
+    auto ops_a = Operands(a), ops_b = Operands(b);
+    for (size_t i = 0; i < ops_a.size(); i++)
+        if (!Same_operand(*ops_a[i], *ops_b[i]))
+            return false;
+    return true;
+}
+
+// 把循环不变的纯指令和安全的load外提到preheader
+// 与已经外提的指令相同时直接使用已有的结果，例如同一循环中对a[i][j]的读和写共用&a[i]
+static void Hoist_loop(Func_IR *func, Loop *loop)
+{
+    Block_IR *preheader = Insert_preheader(func, loop);
+    Loop_effects effects = Collect_effects(loop);
+
+    // 按逆后序遍历，保证操作数先于使用者被外提
+    vector<koopa_raw_value_t> hoisted;
+    map<koopa_raw_value_t, koopa_raw_value_t> same;
+    for (Block_IR *block : func->rpo_order)
+    {
+        if (!loop->Contains(block))
+            continue;
+
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            for (auto op : Operands(inst))
+                if (same.count(*op))
+                    *op = same[*op];
+
+            bool invariant = false;
+            switch (inst->kind.tag)
+            {
+            // 地址计算和算术运算都没有副作用。RISC-V的除法不会产生异常，所以div/mod也可以外提
+            case KOOPA_RVT_BINARY:
+            case KOOPA_RVT_GET_ELEM_PTR:
+            case KOOPA_RVT_GET_PTR:
+                invariant = true;
+                break;
+            case KOOPA_RVT_LOAD:
+                invariant = Can_hoist_load(func, loop, effects, inst, block);
+                break;
+            default:
+                break;
+            }
+
+            if (invariant)
+                for (auto op : Operands(inst))
+                    if (!Is_invariant_operand(func, loop, *op))
+                    {
+                        invariant = false;
+                        break;
+                    }
+
+            koopa_raw_value_t existing = nullptr;
+            if (invariant)
+                for (auto prev : hoisted)
+                    if (Same_inst(prev, inst))
+                        existing = prev;
+            if (existing != nullptr)
+                same[inst] = existing;
+            else if (invariant)
+            {
+                hoisted.push_back(inst);
+                func->def_block[inst] = preheader;
+            }
+            else remain.push_back(inst);
+        }
+        block->insts = remain;
+    }
+
+    // 插入到preheader的跳转指令之前
+    preheader->insts.insert(preheader->insts.end() - 1, hoisted.begin(), hoisted.end());
+    for (auto &item : same)
+    {
+        Replace_uses(func, item.first, item.second);
+        func->def_block.erase(item.first);
+    }
+}
+
+// 循环不变量外提（loop-invariant code motion）
+// 由内向外处理每个循环，内层外提到的指令在处理外层循环时还可以继续外提
+void Licm(Func_IR *func)
+{
+    Build_CFG(func);
+    Find_loops(func);
+
+    for (Loop *loop : func->loops)
+        Hoist_loop(func, loop);
+}
@@ -8,6 +8,8 @@
 #include "inc/ast.hpp"
 #include "inc/koopa.h" // 使用文档提供的文本IR到内存IR转换的标准接口
 #include "inc/riscv.hpp"
+#include "inc/opt.hpp"
+#include "inc/report.hpp"
 #include <map>
 
 using namespace std;
@@ -28,15 +30,47 @@ extern Stack stack;
 extern ST_stack sym_table; // 符号表
 extern bool eof; // 是否遇到return
 
+// 把AST输出为文本形式IR，再转换成内存形式
+koopa_raw_program_t Build_raw(unique_ptr<BaseAST> &ast)
+{
+    // 使用临时文件tmp保存文本形式IR
+    Timed("dump-ir", [&] {
+        ofstream tmp;
+        tmp.open("tmp.koopa");
+        ast->DumpIR(tmp);
+        tmp.close();
+    });
+    
+    // 从临时文件中读出文本形式IR，存入raw
+    char *str = new char [FILE_LEN];
+    Timed("read-koopa", [&] {
+        FILE *fp = fopen("tmp.koopa", "r");
+        fread(str, 1, FILE_LEN, fp);
+        fclose(fp);
+    });
+    koopa_raw_program_t raw;
+    Timed("str2raw", [&] { raw = str2raw(str); });
+    delete [] str;
+
+    return raw;
+}
 
 int main(int argc, const char *argv[]) {
     // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-    // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
+    // compiler 模式 输入文件 -o 输出文件 [优化选项...]
+    assert(argc >= 5);
     auto mode = argv[1];
     auto input = argv[2];
     auto output = argv[4];
 
+    // -perf 模式默认开启优化，其余模式默认不优化
+    if (!strcmp(mode, "-perf"))
+        opt_options.level = 2;
+    opt_options.riscv_target = !strcmp(mode, "-riscv") || !strcmp(mode, "-perf");
+    for (int i = 5; i < argc; i++)
+        if (!Parse_option(argv[i]) && !Parse_report_option(argv[i]))
+            cerr << "unknown option " << argv[i] << endl;
+
     // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
     yyin = fopen(input, "r");
     assert(yyin);
@@ -44,20 +78,41 @@ int main(int argc, const char *argv[]) {
 
     // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
     unique_ptr<BaseAST> ast;
-    auto ret = yyparse(ast);
+    int ret;
+    Timed("parse", [&] { ret = yyparse(ast); });
     assert(!ret);
 
-    ast->Semantic();
-    ast->DistriReg(0);
+    Timed("semantic", [&] { ast->Semantic(); });
+    Timed("distri-reg", [&] { ast->DistriReg(0); });
 
     // 根据mode决定生成何种形式文件
     // koopa IR
     if (!strcmp(mode, "-koopa"))
     {
-        ofstream yyout;
-        yyout.open(output);
-        ast->DumpIR(yyout);
-        yyout.close();
+        if (opt_options.level == 0)
+        {
+            Timed("dump-ir", [&] {
+                ofstream yyout;
+                yyout.open(output);
+                ast->DumpIR(yyout);
+                yyout.close();
+            });
+        }
+
+        // 输出优化后的IR
+        else 
+        {
+            koopa_raw_program_t raw = Build_raw(ast);
+            Timed("optimize", [&] { Optimize(raw); });
+
+            Timed("dump-koopa", [&] {
+                koopa_program_t program;
+                koopa_error_code_t ret = koopa_generate_raw_to_koopa(&raw, &program);
+                assert(ret == KOOPA_EC_SUCCESS);
+                koopa_dump_to_file(program, output);
+                koopa_delete_program(program);
+            });
+        }
 
         // ast->DumpIR(cout);
     }
@@ -65,30 +120,25 @@ int main(int argc, const char *argv[]) {
     // 目标代码
     else if (!strcmp(mode, "-riscv") || !strcmp(mode, "-perf"))
     {
-        // 使用临时文件tmp保存文本形式IR
-        ofstream tmp;
-        tmp.open("tmp.koopa");
-        ast->DumpIR(tmp);
-        tmp.close();
-        
-        // 从临时文件中读出文本形式IR，存入raw
-        FILE *fp = fopen("tmp.koopa", "r");
-        char *str = new char [FILE_LEN];
-        fread(str, 1, FILE_LEN, fp);
-        koopa_raw_program_t raw = str2raw(str);
-        delete [] str;
+        koopa_raw_program_t raw = Build_raw(ast);
+        if (opt_options.level > 0)
+            Timed("optimize", [&] { Optimize(raw); });
 
         // registers.clear();
         // Dist_regs(raw);
 
-        ofstream yyout;
-        yyout.open(output);
-        DumpRISC(raw, yyout);
-        yyout.close();
+        Timed("dump-riscv", [&] {
+            ofstream yyout;
+            yyout.open(output);
+            DumpRISC(raw, yyout);
+            yyout.close();
+        });
     }
 
     else cerr << "wrong mode." << endl;
 
+    // -time-passes、-mem-report的统计输出到标准错误，不影响输出文件
+    Print_report(cerr);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "inc/opt.hpp"
+
+#define MEMO_MAX_PARAMS 3
+
+// 每个函数的表有4096项，多个参数时平分到各维：每个参数的取值范围为[0, dim)
+static const int memo_dims[MEMO_MAX_PARAMS + 1] = {0, 4096, 64, 16};
+
+// 参数和返回值都是int的函数
+static bool Is_int_func(Func_IR *func)
+{
+    auto &params = func->func->params;
+    if (func->Is_decl() || func->func->ty->data.function.ret->tag != KOOPA_RTT_INT32)
+        return false;
+    for (size_t i = 0; i < params.len; i++)
+        if (reinterpret_cast<koopa_raw_value_t>(params.buffer[i])->ty->tag != KOOPA_RTT_INT32)
+            return false;
+    return true;
+}
+
+// 纯函数：不访问全局变量，只调用纯函数（库函数都有输入输出，不是纯函数），结果只由参数决定
+static set<Func_IR *> Find_pure(Program_IR *prog, map<koopa_raw_function_t, Func_IR *> &func_of)
+{
+    set<Func_IR *> pure;
+    for (Func_IR *func : prog->funcs)
+        if (Is_int_func(func))
+            pure.insert(func);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (Func_IR *func : prog->funcs)
+        {
+            if (!pure.count(func))
+                continue;
+            bool ok = true;
+            for (Block_IR *block : func->blocks)
+                for (auto inst : block->insts)
+                {
+                    koopa_raw_value_t ptr = nullptr;
+                    if (inst->kind.tag == KOOPA_RVT_LOAD)
+                        ptr = inst->kind.data.load.src;
+                    else if (inst->kind.tag == KOOPA_RVT_STORE)
+                        ptr = inst->kind.data.store.dest;
+                    else if (inst->kind.tag == KOOPA_RVT_CALL && !pure.count(func_of[inst->kind.data.call.callee]))
+                        ok = false;
+                    if (ptr != nullptr && Mem_base(ptr)->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                        ok = false;
+                }
+            if (!ok)
+            {
+                pure.erase(func);
+                changed = true;
+            }
+        }
+    }
+    return pure;
+}
+
+static bool Is_recursive(Func_IR *func)
+{
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            if (inst->kind.tag == KOOPA_RVT_CALL && inst->kind.data.call.callee == func->func)
+                return true;
+    return false;
+}
+
+// 在函数入口查表，命中时直接返回；每个ret之前把结果写入表中
+// 参数超出范围时使用表末尾多出的一项，它的有效标志始终为0，所以不会命中
+static void Memoize(Program_IR *prog, Func_IR *func)
+{
+    auto &params = func->func->params;
+    int dim = memo_dims[params.len];
+    int size = 1;
+    for (size_t i = 0; i < params.len; i++)
+        size *= dim;
+
+    koopa_raw_value_t values = New_global(Array_type(Int32_type(), size + 1), "memo_value");
+    koopa_raw_value_t valid = New_global(Array_type(Int32_type(), size + 1), "memo_valid");
+    prog->values.push_back(values);
+    prog->values.push_back(valid);
+
+    // 参数在调用其他函数之前仍在a0-a7中，入口处可以直接使用
+    Block_IR *entry = New_block("memo_entry");
+    Block_IR *hit = New_block("memo_hit");
+    Block_IR *body = func->blocks[0];
+    vector<koopa_raw_value_t> &insts = entry->insts;
+    koopa_raw_value_t in_range = New_integer(1), index = New_integer(0);
+    for (size_t i = 0; i < params.len; i++)
+    {
+        koopa_raw_value_t param = reinterpret_cast<koopa_raw_value_t>(params.buffer[i]);
+        koopa_raw_value_t ge = New_binary(KOOPA_RBO_GE, param, New_integer(0));
+        koopa_raw_value_t lt = New_binary(KOOPA_RBO_LT, param, New_integer(dim));
+        insts.push_back(ge);
+        insts.push_back(lt);
+        insts.push_back(in_range = New_binary(KOOPA_RBO_AND, in_range, ge));
+        insts.push_back(in_range = New_binary(KOOPA_RBO_AND, in_range, lt));
+        if (i > 0)
+            insts.push_back(index = New_binary(KOOPA_RBO_MUL, index, New_integer(dim)));
+        insts.push_back(index = New_binary(KOOPA_RBO_ADD, index, param));
+    }
+    // slot = size + in_range * (index - size)
+    koopa_raw_value_t diff = New_binary(KOOPA_RBO_SUB, index, New_integer(size));
+    koopa_raw_value_t masked = New_binary(KOOPA_RBO_MUL, in_range, diff);
+    koopa_raw_value_t slot = New_binary(KOOPA_RBO_ADD, masked, New_integer(size));
+    koopa_raw_value_t value_ptr = New_getelemptr(values, slot);
+    koopa_raw_value_t valid_ptr = New_getelemptr(valid, slot);
+    koopa_raw_value_t flag = New_load(valid_ptr);
+    insts.insert(insts.end(), {diff, masked, slot, value_ptr, valid_ptr, flag, New_branch(flag, hit, body)});
+
+    koopa_raw_value_t cached = New_load(value_ptr);
+    hit->insts = {cached, New_ret(cached)};
+
+    for (Block_IR *block : func->blocks)
+    {
+        koopa_raw_value_t ret = block->Terminator();
+        if (ret->kind.tag != KOOPA_RVT_RETURN)
+            continue;
+        block->insts.insert(block->insts.end() - 1, {New_store(ret->kind.data.ret.value, value_ptr), New_store(in_range, valid_ptr)});
+    }
+
+    // 局部变量移到新的入口块
+    vector<koopa_raw_value_t> allocs, remain;
+    for (auto inst : body->insts)
+    {
+        if (inst->kind.tag == KOOPA_RVT_ALLOC)
+            allocs.push_back(inst);
+        else remain.push_back(inst);
+    }
+    body->insts = remain;
+    insts.insert(insts.begin(), allocs.begin(), allocs.end());
+
+    func->blocks.insert(func->blocks.begin(), {entry, hit});
+}
+
+// 自动记忆化（memoization）
+// 参数和返回值都是int、不访问全局变量也不做输入输出的递归函数，结果只由参数决定，
+// 用一张全局表记录参数较小时已经算出的结果，避免fib、comb这类朴素递归的指数级重复计算。
+// 每次调用都要多执行查表和写表的指令，并占用全局内存，默认不打开，用-fmemoize打开
+void Memoize_recursion(Program_IR *prog)
+{
+    map<koopa_raw_function_t, Func_IR *> func_of;
+    for (Func_IR *func : prog->funcs)
+        func_of[func->func] = func;
+
+    set<Func_IR *> pure = Find_pure(prog, func_of);
+    for (Func_IR *func : prog->funcs)
+    {
+        size_t n = func->func->params.len;
+        if (pure.count(func) && n >= 1 && n <= MEMO_MAX_PARAMS && Is_recursive(func))
+            Memoize(prog, func);
+    }
+}
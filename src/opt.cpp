@@ -0,0 +1,773 @@
+#include "inc/opt.hpp"
+#include "inc/report.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+Opt_options opt_options;
+int opt_block_num; // 优化过程中新建基本块的编号
+int opt_var_num; // 优化过程中新建变量的编号
+
+// 解析命令行中的优化选项，例如 -O2、-fno-licm
+bool Parse_option(const char *arg)
+{
+    string opt = arg;
+    if (opt.size() == 3 && opt.substr(0, 2) == "-O" && isdigit(opt[2]))
+        opt_options.level = opt[2] - '0';
+    else if (opt == "-finterchange")
+        opt_options.interchange = true;
+    else if (opt == "-fno-interchange")
+        opt_options.interchange = false;
+    else if (opt == "-floop-idioms")
+        opt_options.loop_idioms = true;
+    else if (opt == "-fno-loop-idioms")
+        opt_options.loop_idioms = false;
+    else if (opt == "-flicm")
+        opt_options.licm = true;
+    else if (opt == "-fno-licm")
+        opt_options.licm = false;
+    else if (opt == "-fpromote-globals")
+        opt_options.promote_globals = true;
+    else if (opt == "-fno-promote-globals")
+        opt_options.promote_globals = false;
+    else if (opt == "-fvectorize")
+        opt_options.vectorize = true;
+    else if (opt == "-fno-vectorize")
+        opt_options.vectorize = false;
+    else if (opt == "-fstrength-reduce")
+        opt_options.strength_reduce = true;
+    else if (opt == "-fno-strength-reduce")
+        opt_options.strength_reduce = false;
+    else if (opt == "-funroll")
+        opt_options.unroll = true;
+    else if (opt == "-fno-unroll")
+        opt_options.unroll = false;
+    else if (opt == "-fif-convert")
+        opt_options.if_convert = true;
+    else if (opt == "-fno-if-convert")
+        opt_options.if_convert = false;
+    else if (opt == "-fload-elim")
+        opt_options.load_elim = true;
+    else if (opt == "-fno-load-elim")
+        opt_options.load_elim = false;
+    else if (opt == "-fdse")
+        opt_options.dse = true;
+    else if (opt == "-fno-dse")
+        opt_options.dse = false;
+    else if (opt == "-fdce")
+        opt_options.dce = true;
+    else if (opt == "-fno-dce")
+        opt_options.dce = false;
+    else if (opt == "-ftail-calls")
+        opt_options.tail_calls = true;
+    else if (opt == "-fno-tail-calls")
+        opt_options.tail_calls = false;
+    else if (opt == "-fipcp")
+        opt_options.ipcp = true;
+    else if (opt == "-fno-ipcp")
+        opt_options.ipcp = false;
+    else if (opt == "-fmemoize")
+        opt_options.memoize = true;
+    else if (opt == "-fno-memoize")
+        opt_options.memoize = false;
+    else if (opt == "-fstrip-dead")
+        opt_options.strip_dead = true;
+    else if (opt == "-fno-strip-dead")
+        opt_options.strip_dead = false;
+    else if (opt == "-finline")
+        opt_options.inline_funcs = true;
+    else if (opt == "-fno-inline")
+        opt_options.inline_funcs = false;
+    else if (opt.substr(0, 15) == "-finline-limit=" && opt.size() > 15 && isdigit(opt[15]))
+        opt_options.inline_limit = atoi(opt.c_str() + 15);
+    else if (opt.substr(0, 16) == "-funroll-factor=" && opt.size() > 16 && isdigit(opt[16]))
+        opt_options.unroll_factor = max(1, atoi(opt.c_str() + 16));
+    else return false;
+    return true;
+}
+
+// 类型
+koopa_raw_type_t Int32_type()
+{
+    static koopa_raw_type_kind_t ty = {KOOPA_RTT_INT32};
+    return &ty;
+}
+
+koopa_raw_type_t Unit_type()
+{
+    static koopa_raw_type_kind_t ty = {KOOPA_RTT_UNIT};
+    return &ty;
+}
+
+koopa_raw_type_t Pointer_type(koopa_raw_type_t base)
+{
+    koopa_raw_type_kind_t *ty = new koopa_raw_type_kind_t;
+    ty->tag = KOOPA_RTT_POINTER;
+    ty->data.pointer.base = base;
+    return ty;
+}
+
+koopa_raw_type_t Array_type(koopa_raw_type_t base, int len)
+{
+    koopa_raw_type_kind_t *ty = new koopa_raw_type_kind_t;
+    ty->tag = KOOPA_RTT_ARRAY;
+    ty->data.array.base = base;
+    ty->data.array.len = len;
+    return ty;
+}
+
+// 类型占用的字节数
+int Type_size(koopa_raw_type_t ty)
+{
+    if (ty->tag == KOOPA_RTT_ARRAY)
+        return ty->data.array.len * Type_size(ty->data.array.base);
+    if (ty->tag == KOOPA_RTT_UNIT)
+        return 0;
+    return 4;
+}
+
+// 用vector构造slice
+koopa_raw_slice_t Make_slice(const vector<const void *> &items, koopa_raw_slice_item_kind_t kind)
+{
+    koopa_raw_slice_t slice;
+    slice.kind = kind;
+    slice.len = items.size();
+    slice.buffer = nullptr;
+    if (!items.empty())
+    {
+        slice.buffer = new const void *[items.size()];
+        for (size_t i = 0; i < items.size(); i++)
+            slice.buffer[i] = items[i];
+    }
+    return slice;
+}
+
+// 新建一条指令（或常量）。
+// 注意：优化过程中不维护used_by，后端也不会用到它
+koopa_raw_value_data_t *New_value(koopa_raw_type_t ty, koopa_raw_value_tag_t tag)
+{
+    koopa_raw_value_data_t *value = new koopa_raw_value_data_t;
+    value->ty = ty;
+    value->name = nullptr;
+    value->used_by = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    value->kind.tag = tag;
+    return value;
+}
+
+koopa_raw_value_t New_integer(int value)
+{
+    koopa_raw_value_data_t *integer = New_value(Int32_type(), KOOPA_RVT_INTEGER);
+    integer->kind.data.integer.value = value;
+    return integer;
+}
+
+koopa_raw_value_t New_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs)
+{
+    koopa_raw_value_data_t *binary = New_value(Int32_type(), KOOPA_RVT_BINARY);
+    binary->kind.data.binary.op = op;
+    binary->kind.data.binary.lhs = lhs;
+    binary->kind.data.binary.rhs = rhs;
+    return binary;
+}
+
+koopa_raw_value_t New_load(koopa_raw_value_t src)
+{
+    koopa_raw_value_data_t *load = New_value(src->ty->data.pointer.base, KOOPA_RVT_LOAD);
+    load->kind.data.load.src = src;
+    return load;
+}
+
+koopa_raw_value_t New_store(koopa_raw_value_t value, koopa_raw_value_t dest)
+{
+    koopa_raw_value_data_t *store = New_value(Unit_type(), KOOPA_RVT_STORE);
+    store->kind.data.store.value = value;
+    store->kind.data.store.dest = dest;
+    return store;
+}
+
+// 新建一个局部变量，名字在函数中唯一。调用者负责把它放到入口块中
+koopa_raw_value_t New_alloc(koopa_raw_type_t base, string prefix)
+{
+    koopa_raw_value_data_t *alloc = New_value(Pointer_type(base), KOOPA_RVT_ALLOC);
+    string name = "@" + prefix + "_" + to_string(opt_var_num++);
+    char *buf = new char [name.size() + 1];
+    strcpy(buf, name.c_str());
+    alloc->name = buf;
+    return alloc;
+}
+
+// 新建一个初始值为0的全局变量，调用者负责把它加入Program_IR::values
+koopa_raw_value_t New_global(koopa_raw_type_t base, string prefix)
+{
+    koopa_raw_value_data_t *global = New_value(Pointer_type(base), KOOPA_RVT_GLOBAL_ALLOC);
+    string name = "@" + prefix + "_" + to_string(opt_var_num++);
+    char *buf = new char [name.size() + 1];
+    strcpy(buf, name.c_str());
+    global->name = buf;
+    global->kind.data.global_alloc.init = New_value(base, KOOPA_RVT_ZERO_INIT);
+    return global;
+}
+
+koopa_raw_value_t New_getelemptr(koopa_raw_value_t src, koopa_raw_value_t index)
+{
+    koopa_raw_type_t array_ty = src->ty->data.pointer.base;
+    koopa_raw_value_data_t *gep = New_value(Pointer_type(array_ty->data.array.base), KOOPA_RVT_GET_ELEM_PTR);
+    gep->kind.data.get_elem_ptr.src = src;
+    gep->kind.data.get_elem_ptr.index = index;
+    return gep;
+}
+
+koopa_raw_value_t New_ret(koopa_raw_value_t value)
+{
+    koopa_raw_value_data_t *ret = New_value(Unit_type(), KOOPA_RVT_RETURN);
+    ret->kind.data.ret.value = value;
+    return ret;
+}
+
+koopa_raw_value_t New_call(koopa_raw_function_t callee, const vector<koopa_raw_value_t> &args)
+{
+    koopa_raw_value_data_t *call = New_value(callee->ty->data.function.ret, KOOPA_RVT_CALL);
+    call->kind.data.call.callee = callee;
+    call->kind.data.call.args = Make_slice(vector<const void *>(args.begin(), args.end()), KOOPA_RSIK_VALUE);
+    return call;
+}
+
+koopa_raw_value_t New_jump(Block_IR *target)
+{
+    koopa_raw_value_data_t *jump = New_value(Unit_type(), KOOPA_RVT_JUMP);
+    jump->kind.data.jump.target = target->bb;
+    jump->kind.data.jump.args = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    return jump;
+}
+
+koopa_raw_value_t New_branch(koopa_raw_value_t cond, Block_IR *true_block, Block_IR *false_block)
+{
+    koopa_raw_value_data_t *branch = New_value(Unit_type(), KOOPA_RVT_BRANCH);
+    branch->kind.data.branch.cond = cond;
+    branch->kind.data.branch.true_bb = true_block->bb;
+    branch->kind.data.branch.false_bb = false_block->bb;
+    branch->kind.data.branch.true_args = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    branch->kind.data.branch.false_args = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    return branch;
+}
+
+// 新建一个基本块，名字在整个程序中唯一（汇编中的标签是全局的）
+// 新块不会被自动加入函数，由调用者决定它的位置
+Block_IR *New_block(string prefix)
+{
+    koopa_raw_basic_block_data_t *bb = new koopa_raw_basic_block_data_t;
+    string name = "%" + prefix + "_" + to_string(opt_block_num++);
+    char *buf = new char [name.size() + 1];
+    strcpy(buf, name.c_str());
+    bb->name = buf;
+    bb->params = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    bb->used_by = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    bb->insts = Make_slice(vector<const void *>(), KOOPA_RSIK_VALUE);
+    return new Block_IR(bb);
+}
+
+// raw中的指令都是const的，修改时统一经过这里
+koopa_raw_value_data_t *Mut(koopa_raw_value_t value)
+{
+    return const_cast<koopa_raw_value_data_t *>(value);
+}
+
+// 返回指令的所有操作数的位置，便于统一替换
+vector<koopa_raw_value_t *> Operands(koopa_raw_value_t value)
+{
+    vector<koopa_raw_value_t *> ops;
+    auto &kind = Mut(value)->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+        ops.push_back(&kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        ops.push_back(&kind.data.store.value);
+        ops.push_back(&kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        ops.push_back(&kind.data.get_ptr.src);
+        ops.push_back(&kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        ops.push_back(&kind.data.get_elem_ptr.src);
+        ops.push_back(&kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        ops.push_back(&kind.data.binary.lhs);
+        ops.push_back(&kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        ops.push_back(&kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (size_t i = 0; i < kind.data.call.args.len; i++)
+            ops.push_back(reinterpret_cast<koopa_raw_value_t *>(&kind.data.call.args.buffer[i]));
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value != nullptr)
+            ops.push_back(&kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+    return ops;
+}
+
+// 把函数中对from的所有使用替换为to
+void Replace_uses(Func_IR *func, koopa_raw_value_t from, koopa_raw_value_t to)
+{
+    for (Block_IR *block : func->blocks)
+        for (auto inst : block->insts)
+            for (auto op : Operands(inst))
+                if (*op == from)
+                    *op = to;
+}
+
+// 复制一条指令，操作数暂时与原指令相同
+koopa_raw_value_t Clone_inst(koopa_raw_value_t inst)
+{
+    koopa_raw_value_data_t *clone = New_value(inst->ty, inst->kind.tag);
+    clone->kind = inst->kind;
+    // call的参数放在单独的数组中，需要复制一份，避免替换操作数时改到原指令
+    if (inst->kind.tag == KOOPA_RVT_CALL)
+    {
+        auto &args = inst->kind.data.call.args;
+        clone->kind.data.call.args = Make_slice(vector<const void *>(args.buffer, args.buffer + args.len), KOOPA_RSIK_VALUE);
+    }
+    return clone;
+}
+
+// 复制一组基本块。块内对这组块中的指令和块的引用都指向副本，其余引用保持不变
+// value_map中可以预先放入需要替换的值（例如函数参数），复制的指令也会被加入其中
+vector<Block_IR *> Clone_blocks(const vector<Block_IR *> &blocks, map<koopa_raw_value_t, koopa_raw_value_t> &value_map)
+{
+    map<Block_IR *, Block_IR *> block_map;
+    vector<Block_IR *> clones;
+    for (Block_IR *block : blocks)
+    {
+        Block_IR *clone = New_block(block->bb->name + 1);
+        block_map[block] = clone;
+        clones.push_back(clone);
+        for (auto inst : block->insts)
+        {
+            koopa_raw_value_t copy = Clone_inst(inst);
+            value_map[inst] = copy;
+            clone->insts.push_back(copy);
+        }
+    }
+
+    for (Block_IR *clone : clones)
+        for (auto inst : clone->insts)
+        {
+            for (auto op : Operands(inst))
+                if (value_map.count(*op))
+                    *op = value_map[*op];
+            if (Is_terminator(inst))
+                for (auto &item : block_map)
+                    Replace_target(inst, item.first, item.second);
+        }
+    return clones;
+}
+
+// 删除不再被使用的无副作用指令（地址计算、算术运算、load），返回是否删除了指令
+bool Remove_unused(Func_IR *func)
+{
+    bool removed = false;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        map<koopa_raw_value_t, int> uses;
+        for (Block_IR *block : func->blocks)
+            for (auto inst : block->insts)
+                for (auto op : Operands(inst))
+                    uses[*op]++;
+
+        for (Block_IR *block : func->blocks)
+        {
+            vector<koopa_raw_value_t> remain;
+            for (auto inst : block->insts)
+            {
+                auto tag = inst->kind.tag;
+                bool pure = tag == KOOPA_RVT_GET_ELEM_PTR || tag == KOOPA_RVT_GET_PTR || tag == KOOPA_RVT_BINARY || tag == KOOPA_RVT_LOAD;
+                if (pure && uses[inst] == 0)
+                {
+                    func->def_block.erase(inst);
+                    changed = removed = true;
+                }
+                else remain.push_back(inst);
+            }
+            block->insts = remain;
+        }
+    }
+    return removed;
+}
+
+// 把跳转指令term中指向from的目标改为to
+void Replace_target(koopa_raw_value_t term, Block_IR *from, Block_IR *to)
+{
+    auto &kind = Mut(term)->kind;
+    if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        if (kind.data.branch.true_bb == from->bb)
+            kind.data.branch.true_bb = to->bb;
+        if (kind.data.branch.false_bb == from->bb)
+            kind.data.branch.false_bb = to->bb;
+    }
+    else if (kind.tag == KOOPA_RVT_JUMP)
+    {
+        if (kind.data.jump.target == from->bb)
+            kind.data.jump.target = to->bb;
+    }
+}
+
+bool Is_terminator(koopa_raw_value_t value)
+{
+    auto tag = value->kind.tag;
+    return tag == KOOPA_RVT_BRANCH || tag == KOOPA_RVT_JUMP || tag == KOOPA_RVT_RETURN;
+}
+
+bool Is_const(koopa_raw_value_t value)
+{
+    return value->kind.tag == KOOPA_RVT_INTEGER;
+}
+
+// 把raw program拷贝成便于修改的形式
+Program_IR *Build_program(koopa_raw_program_t &program)
+{
+    Program_IR *prog = new Program_IR;
+    prog->raw = &program;
+
+    for (size_t i = 0; i < program.values.len; i++)
+        prog->values.push_back(reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]));
+
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = const_cast<koopa_raw_function_data_t *>(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+        Func_IR *func_ir = new Func_IR(func);
+
+        for (size_t j = 0; j < func->bbs.len; j++)
+        {
+            auto bb = const_cast<koopa_raw_basic_block_data_t *>(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]));
+            Block_IR *block = new Block_IR(bb);
+            for (size_t k = 0; k < bb->insts.len; k++)
+                block->insts.push_back(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]));
+            func_ir->blocks.push_back(block);
+        }
+        prog->funcs.push_back(func_ir);
+    }
+    return prog;
+}
+
+// 把优化后的结果写回raw program
+void Commit_program(Program_IR *prog)
+{
+    vector<const void *> values, funcs;
+    for (auto value : prog->values)
+        values.push_back(value);
+    prog->raw->values = Make_slice(values, KOOPA_RSIK_VALUE);
+
+    for (Func_IR *func : prog->funcs)
+    {
+        vector<const void *> bbs;
+        for (Block_IR *block : func->blocks)
+        {
+            vector<const void *> insts(block->insts.begin(), block->insts.end());
+            block->bb->insts = Make_slice(insts, KOOPA_RSIK_VALUE);
+            bbs.push_back(block->bb);
+        }
+        func->func->bbs = Make_slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+        funcs.push_back(func->func);
+    }
+    prog->raw->funcs = Make_slice(funcs, KOOPA_RSIK_FUNCTION);
+}
+
+// 求支配树时沿idom向上，找到两个块的公共支配者
+static Block_IR *Intersect(Block_IR *a, Block_IR *b)
+{
+    while (a != b)
+    {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+// 建立控制流图：后继、可达前驱、逆后序和支配树
+// 不可达块（例如break之后的while_remain）不参与前驱和支配关系
+void Build_CFG(Func_IR *func)
+{
+    func->block_map.clear();
+    func->def_block.clear();
+    func->rpo_order.clear();
+    for (Block_IR *block : func->blocks)
+    {
+        func->block_map[block->bb] = block;
+        block->preds.clear();
+        block->succs.clear();
+        block->idom = nullptr;
+        block->rpo = -1;
+        for (auto inst : block->insts)
+            func->def_block[inst] = block;
+    }
+    if (func->blocks.empty())
+        return;
+
+    for (Block_IR *block : func->blocks)
+    {
+        auto &kind = block->Terminator()->kind;
+        if (kind.tag == KOOPA_RVT_BRANCH)
+        {
+            block->succs.push_back(func->block_map[kind.data.branch.true_bb]);
+            if (kind.data.branch.false_bb != kind.data.branch.true_bb)
+                block->succs.push_back(func->block_map[kind.data.branch.false_bb]);
+        }
+        else if (kind.tag == KOOPA_RVT_JUMP)
+            block->succs.push_back(func->block_map[kind.data.jump.target]);
+    }
+
+    // 非递归的DFS求后序，避免函数很大时栈溢出
+    vector<Block_IR *> post_order;
+    set<Block_IR *> visited;
+    vector<pair<Block_IR *, size_t>> dfs_stack;
+    dfs_stack.push_back(make_pair(func->blocks[0], 0));
+    visited.insert(func->blocks[0]);
+    while (!dfs_stack.empty())
+    {
+        Block_IR *block = dfs_stack.back().first;
+        size_t &next = dfs_stack.back().second;
+        if (next < block->succs.size())
+        {
+            Block_IR *succ = block->succs[next++];
+            if (!visited.count(succ))
+            {
+                visited.insert(succ);
+                dfs_stack.push_back(make_pair(succ, 0));
+            }
+        }
+        else
+        {
+            post_order.push_back(block);
+            dfs_stack.pop_back();
+        }
+    }
+    func->rpo_order.assign(post_order.rbegin(), post_order.rend());
+    for (size_t i = 0; i < func->rpo_order.size(); i++)
+        func->rpo_order[i]->rpo = i;
+
+    for (Block_IR *block : func->rpo_order)
+        for (Block_IR *succ : block->succs)
+            succ->preds.push_back(block);
+
+    // Cooper-Harvey-Kennedy 迭代算法求直接支配者
+    Block_IR *entry = func->rpo_order[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < func->rpo_order.size(); i++)
+        {
+            Block_IR *block = func->rpo_order[i];
+            Block_IR *new_idom = nullptr;
+            for (Block_IR *pred : block->preds)
+            {
+                if (pred->idom == nullptr) continue;
+                new_idom = (new_idom == nullptr) ? pred : Intersect(pred, new_idom);
+            }
+            if (new_idom != block->idom)
+            {
+                block->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+// a是否支配b
+bool Func_IR::Dominates(Block_IR *a, Block_IR *b) const
+{
+    if (a->rpo < 0 || b->rpo < 0)
+        return false;
+    while (true)
+    {
+        if (a == b) return true;
+        if (b->idom == b) return false;
+        b = b->idom;
+    }
+}
+
+vector<Block_IR *> Loop::Exiting_blocks() const
+{
+    vector<Block_IR *> exiting;
+    for (Block_IR *block : blocks)
+        for (Block_IR *succ : block->succs)
+            if (!Contains(succ))
+            {
+                exiting.push_back(block);
+                break;
+            }
+    return exiting;
+}
+
+// 寻找所有自然循环：回边 latch -> header 满足 header 支配 latch
+void Find_loops(Func_IR *func)
+{
+    map<Block_IR *, Loop *> loop_of_header;
+    func->loops.clear();
+
+    for (Block_IR *block : func->rpo_order)
+        for (Block_IR *succ : block->succs)
+        {
+            if (!func->Dominates(succ, block))
+                continue;
+            Loop *&loop = loop_of_header[succ];
+            if (loop == nullptr)
+            {
+                loop = new Loop(succ);
+                loop->blocks.insert(succ);
+                func->loops.push_back(loop);
+            }
+            loop->latches.push_back(block);
+
+            // 从latch沿前驱反向搜索，直到header
+            vector<Block_IR *> work;
+            if (!loop->Contains(block))
+            {
+                loop->blocks.insert(block);
+                work.push_back(block);
+            }
+            while (!work.empty())
+            {
+                Block_IR *cur = work.back();
+                work.pop_back();
+                for (Block_IR *pred : cur->preds)
+                    if (!loop->Contains(pred))
+                    {
+                        loop->blocks.insert(pred);
+                        work.push_back(pred);
+                    }
+            }
+        }
+
+    // 内层循环的块数一定更少，按块数排序后内层循环在前
+    stable_sort(func->loops.begin(), func->loops.end(), [](Loop *a, Loop *b) {
+        return a->blocks.size() < b->blocks.size();
+    });
+
+    // 确定嵌套关系：包含header的最小的其他循环即为父循环
+    for (size_t i = 0; i < func->loops.size(); i++)
+        for (size_t j = i + 1; j < func->loops.size(); j++)
+            if (func->loops[j]->Contains(func->loops[i]->header))
+            {
+                func->loops[i]->parent = func->loops[j];
+                func->loops[j]->children.push_back(func->loops[i]);
+                break;
+            }
+    for (Loop *loop : func->loops)
+    {
+        loop->depth = 1;
+        for (Loop *p = loop->parent; p != nullptr; p = p->parent)
+            loop->depth++;
+    }
+}
+
+// 为循环创建preheader：循环外所有跳到header的边都改为跳到preheader
+// 如果循环外只有一个前驱，且它只跳到header，就直接把它当作preheader
+Block_IR *Insert_preheader(Func_IR *func, Loop *loop)
+{
+    Block_IR *header = loop->header;
+    vector<Block_IR *> outside;
+    for (Block_IR *pred : header->preds)
+        if (!loop->Contains(pred))
+            outside.push_back(pred);
+
+    if (outside.size() == 1 && outside[0]->succs.size() == 1)
+    {
+        loop->preheader = outside[0];
+        return loop->preheader;
+    }
+
+    Block_IR *preheader = New_block("preheader");
+    preheader->insts.push_back(New_jump(header));
+    for (Block_IR *pred : outside)
+        Replace_target(pred->Terminator(), header, preheader);
+
+    // preheader放在header之前；如果header是入口块，preheader成为新的入口
+    auto pos = find(func->blocks.begin(), func->blocks.end(), header);
+    func->blocks.insert(pos, preheader);
+
+    // preheader属于所有外层循环
+    for (Loop *p = loop->parent; p != nullptr; p = p->parent)
+        p->blocks.insert(preheader);
+
+    loop->preheader = preheader;
+    Build_CFG(func);
+    return preheader;
+}
+
+// 优化入口
+void Optimize(koopa_raw_program_t &program)
+{
+    Program_IR *prog;
+    Timed("build-program", [&] { prog = Build_program(program); });
+
+    if (opt_options.dce)
+        Timed("dce", [&] {
+            for (Func_IR *func : prog->funcs)
+                Dce(func);
+        });
+    if (opt_options.ipcp)
+        Timed("ipcp", [&] { Ipcp(prog); });
+    if (opt_options.memoize)
+        Timed("memoize", [&] { Memoize_recursion(prog); });
+    if (opt_options.tail_calls)
+        Timed("tail-recursion", [&] {
+            for (Func_IR *func : prog->funcs)
+                Tail_recursion(func);
+        });
+    if (opt_options.inline_funcs)
+        Timed("inline", [&] { Inline(prog); });
+    // 内联、特化后没有调用者的函数不必再优化；函数内的优化删除调用后再清理一次
+    if (opt_options.strip_dead)
+        Timed("strip-dead", [&] { Strip_dead(prog); });
+
+    // 向量化可能向prog->funcs中加入例程的声明，遍历一份拷贝
+    // 同一个遍对各个函数的耗时累加在一起
+    vector<Func_IR *> funcs = prog->funcs;
+    for (Func_IR *func : funcs)
+    {
+        if (func->Is_decl())
+            continue;
+
+        if (opt_options.interchange)
+            Timed("interchange", [&] { Interchange_loops(func); });
+        if (opt_options.licm)
+            Timed("licm", [&] { Licm(func); });
+        // 边界、数组基址等在循环中不变的值外提之后更容易识别
+        if (opt_options.loop_idioms)
+            Timed("loop-idioms", [&] { Loop_idioms(prog, func); });
+        if (opt_options.promote_globals)
+            Timed("promote-globals", [&] { Promote_globals(func); });
+        if (opt_options.vectorize)
+            Timed("vectorize", [&] { Vectorize(prog, func); });
+        if (opt_options.strength_reduce)
+            Timed("strength-reduce", [&] { Strength_reduce(func); });
+        if (opt_options.unroll)
+            Timed("unroll", [&] { Unroll(func); });
+        if (opt_options.if_convert)
+            Timed("if-convert", [&] { If_convert(func); });
+        if (opt_options.load_elim)
+            Timed("load-elim", [&] { Forward_loads(func); });
+        if (opt_options.dse)
+            Timed("dse", [&] { Dead_store_elim(func); });
+        if (opt_options.dce)
+            Timed("dce", [&] { Dce(func); });
+    }
+
+    if (opt_options.strip_dead)
+        Timed("strip-dead", [&] { Strip_dead(prog); });
+    Timed("commit-program", [&] { Commit_program(prog); });
+}
@@ -0,0 +1,104 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// 循环中被写入的全局标量变量
+static vector<koopa_raw_value_t> Stored_globals(Loop *loop)
+{
+    vector<koopa_raw_value_t> globals;
+    for (Block_IR *block : loop->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag != KOOPA_RVT_STORE)
+                continue;
+            koopa_raw_value_t dest = inst->kind.data.store.dest;
+            if (dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC && dest->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY
+                && find(globals.begin(), globals.end(), dest) == globals.end())
+                globals.push_back(dest);
+        }
+    return globals;
+}
+
+// 循环中除了直接load/store之外，是否没有其他可能访问global的指令
+static bool Can_promote(Loop *loop, koopa_raw_value_t global)
+{
+    for (Block_IR *block : loop->blocks)
+        for (auto inst : block->insts)
+        {
+            koopa_raw_value_t ptr = nullptr;
+            if (inst->kind.tag == KOOPA_RVT_LOAD)
+                ptr = inst->kind.data.load.src;
+            else if (inst->kind.tag == KOOPA_RVT_STORE)
+                ptr = inst->kind.data.store.dest;
+            else if (inst->kind.tag == KOOPA_RVT_CALL && Call_may_access(inst, global))
+                return false;
+            if (ptr != nullptr && ptr != global && Alias(ptr, global) != NO_ALIAS)
+                return false;
+        }
+    return true;
+}
+
+// 把循环中对global的访问改为访问局部变量：preheader中读入，每条离开循环的边上写回
+static void Promote(Func_IR *func, Loop *loop, koopa_raw_value_t global)
+{
+    Block_IR *preheader = Insert_preheader(func, loop);
+
+    koopa_raw_value_t var = New_alloc(global->ty->data.pointer.base, "promoted");
+    func->blocks[0]->insts.insert(func->blocks[0]->insts.begin(), var);
+    func->def_block[var] = func->blocks[0];
+
+    koopa_raw_value_t init = New_load(global);
+    preheader->insts.insert(preheader->insts.end() - 1, {init, New_store(init, var)});
+
+    for (Block_IR *block : loop->blocks)
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_LOAD && inst->kind.data.load.src == global)
+                Mut(inst)->kind.data.load.src = var;
+            else if (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.dest == global)
+                Mut(inst)->kind.data.store.dest = var;
+        }
+
+    // 每条出口边上插入写回的块
+    vector<pair<Block_IR *, Block_IR *>> exits;
+    for (Block_IR *block : loop->blocks)
+        for (Block_IR *succ : block->succs)
+            if (!loop->Contains(succ) && find(exits.begin(), exits.end(), make_pair(block, succ)) == exits.end())
+                exits.push_back(make_pair(block, succ));
+    for (auto &edge : exits)
+    {
+        Block_IR *store_back = New_block("promote_exit");
+        koopa_raw_value_t value = New_load(var);
+        store_back->insts = {value, New_store(value, global), New_jump(edge.second)};
+        Replace_target(edge.first->Terminator(), edge.second, store_back);
+
+        auto pos = find(func->blocks.begin(), func->blocks.end(), edge.second);
+        func->blocks.insert(pos, store_back);
+        for (Loop *p = loop->parent; p != nullptr; p = p->parent)
+            p->blocks.insert(store_back);
+    }
+    Build_CFG(func);
+}
+
+// 由外向内处理：外层循环中可以提升的变量在内层循环中也不再出现
+static void Promote_loop(Func_IR *func, Loop *loop)
+{
+    for (auto global : Stored_globals(loop))
+        if (Can_promote(loop, global))
+            Promote(func, loop, global);
+    for (Loop *child : loop->children)
+        Promote_loop(func, child);
+}
+
+// 全局变量提升（scalar promotion of globals）
+// 循环中读写全局标量时每次都要先用la取得地址。循环中没有可能访问它的函数调用或指针访问时，
+// 改为在进入循环前读入一个局部变量，循环中只访问局部变量，离开循环时再写回
+// 只读的全局变量由LICM外提，这里只处理循环中有store的变量
+void Promote_globals(Func_IR *func)
+{
+    Build_CFG(func);
+    Find_loops(func);
+
+    for (Loop *loop : func->loops)
+        if (loop->parent == nullptr)
+            Promote_loop(func, loop);
+}
@@ -0,0 +1,173 @@
+#include "inc/report.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sys/resource.h>
+#include <unistd.h>
+
+Report_options report_options;
+static vector<Phase_record> records; // 按第一次开始的顺序排列
+static map<string, int> record_index;
+static int cur_depth;
+
+// 解析报告选项，不是报告选项时返回false
+bool Parse_report_option(const char *arg)
+{
+    string opt = arg;
+    if (opt == "-time-passes")
+        report_options.time_passes = true;
+    else if (opt == "-mem-report")
+        report_options.mem_report = true;
+    else if (opt == "-report-format=json")
+        report_options.json = true;
+    else if (opt == "-report-format=table")
+        report_options.json = false;
+    else return false;
+    return true;
+}
+
+static double Wall_ms()
+{
+    using namespace chrono;
+    return duration<double, milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double Cpu_ms()
+{
+    return 1000.0 * clock() / CLOCKS_PER_SEC;
+}
+
+// 当前RSS（KB），从/proc/self/statm读取；读不到时为0
+static long Current_rss_kb()
+{
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == nullptr)
+        return 0;
+    long size = 0, resident = 0;
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// 进程的RSS峰值（KB），Linux上ru_maxrss的单位就是KB
+static long Peak_rss_kb()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+Phase_timer::Phase_timer(const char *name): index(-1)
+{
+    if (!report_options.Enabled())
+        return;
+
+    auto it = record_index.find(name);
+    if (it == record_index.end())
+    {
+        Phase_record record = {name, cur_depth, 0, 0, 0, 0, 0};
+        it = record_index.insert({name, (int)records.size()}).first;
+        records.push_back(record);
+    }
+    index = it->second;
+    cur_depth++;
+    wall_start = Wall_ms();
+    cpu_start = Cpu_ms();
+    rss_start = Current_rss_kb();
+}
+
+Phase_timer::~Phase_timer()
+{
+    if (index < 0)
+        return;
+
+    Phase_record &record = records[index];
+    record.calls++;
+    record.wall_ms += Wall_ms() - wall_start;
+    record.cpu_ms += Cpu_ms() - cpu_start;
+    record.rss_delta_kb += Current_rss_kb() - rss_start;
+    record.peak_rss_kb = Peak_rss_kb();
+    cur_depth--;
+}
+
+// 顶层阶段之和
+static Phase_record Total()
+{
+    Phase_record total = {"total", 0, 1, 0, 0, 0, 0};
+    for (const Phase_record &record : records)
+        if (record.depth == 0)
+        {
+            total.wall_ms += record.wall_ms;
+            total.cpu_ms += record.cpu_ms;
+            total.rss_delta_kb += record.rss_delta_kb;
+            total.peak_rss_kb = max(total.peak_rss_kb, record.peak_rss_kb);
+        }
+    return total;
+}
+
+static void Print_row(ostream &os, const Phase_record &record)
+{
+    os << left << setw(28) << string(2 * record.depth, ' ') + record.name << right << setw(7) << record.calls;
+    if (report_options.time_passes)
+        os << setw(12) << record.wall_ms << setw(12) << record.cpu_ms;
+    if (report_options.mem_report)
+        os << setw(15) << showpos << record.rss_delta_kb << noshowpos << setw(15) << record.peak_rss_kb;
+    os << endl;
+}
+
+static void Print_table(ostream &os)
+{
+    os << "===== compile time and memory report =====" << endl;
+    os << left << setw(28) << "phase" << right << setw(7) << "calls";
+    if (report_options.time_passes)
+        os << setw(12) << "wall(ms)" << setw(12) << "cpu(ms)";
+    if (report_options.mem_report)
+        os << setw(15) << "rss delta(KB)" << setw(15) << "peak rss(KB)";
+    os << endl;
+
+    os << fixed << setprecision(3);
+    for (const Phase_record &record : records)
+        Print_row(os, record);
+    Print_row(os, Total());
+    os << defaultfloat;
+}
+
+static void Print_object(ostream &os, const Phase_record &record)
+{
+    os << "{\"name\": \"" << record.name << "\", \"depth\": " << record.depth << ", \"calls\": " << record.calls;
+    if (report_options.time_passes)
+        os << ", \"wall_ms\": " << record.wall_ms << ", \"cpu_ms\": " << record.cpu_ms;
+    if (report_options.mem_report)
+        os << ", \"rss_delta_kb\": " << record.rss_delta_kb << ", \"peak_rss_kb\": " << record.peak_rss_kb;
+    os << "}";
+}
+
+static void Print_json(ostream &os)
+{
+    os << fixed << setprecision(3);
+    os << "{\"phases\": [";
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        os << (i == 0 ? "" : ",") << endl << "  ";
+        Print_object(os, records[i]);
+    }
+    os << endl << "], \"total\": ";
+    Print_object(os, Total());
+    os << "}" << endl;
+    os << defaultfloat;
+}
+
+// 输出所有阶段的统计。阶段名都是程序中的常量，输出JSON时不需要转义
+void Print_report(ostream &os)
+{
+    if (!report_options.Enabled())
+        return;
+    if (report_options.json)
+        Print_json(os);
+    else Print_table(os);
+}
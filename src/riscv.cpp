@@ -1,10 +1,21 @@
 #include "inc/riscv.hpp"
 #include "inc/ST.hpp"
+#include "inc/opt.hpp"
 
 map<koopa_raw_value_t, string> registers;
 Stack rstack; // 记录该变量在栈中相对栈指针的偏移量
 map<koopa_raw_value_t, string> glob_data; // 储存全局变量名
 int new_branch_num; // 用于间接跳转的新标签
+set<koopa_raw_value_t> written_globals; // 可能被写入的全局变量，其余的放在只读数据段
+set<koopa_raw_function_t> called_funcs; // 被调用的函数，只有被调用的内部例程才输出
+
+// 跳转指令的范围（字节），留出一些余量
+#define BRANCH_RANGE 4000 // bnez/beqz: ±4KiB
+#define JUMP_RANGE 1000000 // j: ±1MiB
+#define TERM_SIZE 96 // 一条br/jump/ret翻译后的最大长度
+map<koopa_raw_basic_block_t, int> block_pos; // 基本块在函数中起始位置的估计（字节，偏大）
+koopa_raw_basic_block_t next_bb; // 输出顺序中紧随当前块之后的块
+int cur_end; // 当前块（不含最后的跳转指令）结束位置的估计
 
 // 将文本形式IR转换为内存形式
 koopa_raw_program_t str2raw(const char *str)
@@ -164,7 +175,56 @@ int Stack_size(const koopa_raw_function_t &func)
         // S_size不需要+1，因为参数存在上一个函数（调用者）的栈帧中
     }
 
-    return Stack_size(func->bbs);
+    // 只在定义它的基本块中被使用的值（绝大部分临时值）在离开这个块后就不再需要，
+    // 不同基本块中的这类值可以共用同一段栈空间，这样栈帧更小，偏移量也更容易落在addi/lw的立即数范围内
+    map<koopa_raw_value_t, koopa_raw_basic_block_t> def_bb;
+    set<koopa_raw_value_t> shared; // 在其他块中被使用的值，以及alloc
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            koopa_raw_value_t value = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            def_bb[value] = bb;
+            if (value->kind.tag == KOOPA_RVT_ALLOC)
+                shared.insert(value);
+        }
+    }
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+            for (auto op : Operands(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j])))
+                if (def_bb.count(*op) && def_bb[*op] != bb)
+                    shared.insert(*op);
+    }
+
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            koopa_raw_value_t value = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (shared.count(value))
+                Stack_size(value);
+        }
+    }
+
+    int shared_size = rstack.S_size, local_size = 0;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        rstack.S_size = shared_size;
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            koopa_raw_value_t value = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (!shared.count(value))
+                Stack_size(value);
+        }
+        local_size = max(local_size, rstack.S_size - shared_size);
+    }
+    rstack.S_size = shared_size + local_size;
+    return rstack.S_size;
 }
 
 // 计算基本块需要的栈空间
@@ -197,7 +257,7 @@ int Stack_size(const koopa_raw_value_t &value)
     if (value->kind.tag == KOOPA_RVT_CALL)
     {
         int arg_num = value->kind.data.call.args.len;
-        rstack.A_size = 4 * max(rstack.A_size, arg_num - 8);
+        rstack.A_size = max(rstack.A_size, 4 * (arg_num - 8));
         rstack.R_size = 4;
         // return 4; // %1 = call f()
     }
@@ -221,11 +281,70 @@ int Ptr_size(const koopa_raw_type_t &ty)
 }
 
 
+// 找出可能被写入的全局变量：作为store的目标，或地址被存入内存、传给函数
+void Find_written_globals(const koopa_raw_program_t &program)
+{
+    written_globals.clear();
+    auto mark = [](koopa_raw_value_t ptr) {
+        if (ptr->ty->tag != KOOPA_RTT_POINTER)
+            return;
+        koopa_raw_value_t base = Mem_base(ptr);
+        if (base->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+            written_globals.insert(base);
+    };
+
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        for (size_t j = 0; j < func->bbs.len; j++)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+            for (size_t k = 0; k < bb->insts.len; k++)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]);
+                if (inst->kind.tag == KOOPA_RVT_STORE)
+                {
+                    mark(inst->kind.data.store.dest);
+                    mark(inst->kind.data.store.value);
+                }
+                else if (inst->kind.tag == KOOPA_RVT_CALL)
+                {
+                    auto &args = inst->kind.data.call.args;
+                    for (size_t l = 0; l < args.len; l++)
+                        mark(reinterpret_cast<koopa_raw_value_t>(args.buffer[l]));
+                }
+            }
+        }
+    }
+}
+
+// 找出程序中被调用的所有函数
+void Find_called_funcs(const koopa_raw_program_t &program)
+{
+    called_funcs.clear();
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        for (size_t j = 0; j < func->bbs.len; j++)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+            for (size_t k = 0; k < bb->insts.len; k++)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]);
+                if (inst->kind.tag == KOOPA_RVT_CALL)
+                    called_funcs.insert(inst->kind.data.call.callee);
+            }
+        }
+    }
+}
+
 // 访问 raw program
 void DumpRISC(const koopa_raw_program_t &program, ostream &os)
 {
     // os << ".text" << endl;
 
+    Find_written_globals(program);
+    Find_called_funcs(program);
     DumpRISC(program.values, os);
     // 访问所有函数
     DumpRISC(program.funcs, os);
@@ -267,7 +386,10 @@ void DumpRISC(const koopa_raw_global_alloc_t &alloc, const koopa_raw_value_t &va
     string name = "var_" + to_string(num);
     glob_data[value] = name;
 
-    os << ".data" << endl;
+    // 从不被写入的全局变量（如常量数组）放在只读数据段
+    if (written_globals.count(value))
+        os << ".data" << endl;
+    else os << ".section .rodata" << endl;
     os << ".globl " << name << endl;
     os << name << ":" << endl;
 
@@ -281,27 +403,210 @@ void DumpRISC(const koopa_raw_global_alloc_t &alloc, const koopa_raw_value_t &va
         DumpRISC(alloc.init->kind.data.aggregate, os);
 }
 
+// 全局变量的初始值，连续的0合并成一条.zero，zeros是尚未输出的0的字节数
+static void Init_dump(koopa_raw_value_t value, int &zeros, ostream &os)
+{
+    if (value->kind.tag == KOOPA_RVT_AGGREGATE)
+    {
+        auto &elems = value->kind.data.aggregate.elems;
+        for (int i = 0; i < elems.len; i++)
+            Init_dump(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]), zeros, os);
+    }
+    else if (value->kind.tag == KOOPA_RVT_ZERO_INIT)
+        zeros += Type_size(value->ty);
+    else if (value->kind.data.integer.value == 0) // value->kind.tag == KOOPA_RVT_INTEGER
+        zeros += 4;
+    else
+    {
+        if (zeros > 0)
+            os << ".zero " << zeros << endl;
+        zeros = 0;
+        os << ".word " << value->kind.data.integer.value << endl;
+    }
+}
+
 // aggregate
 void DumpRISC(const koopa_raw_aggregate_t &aggregate, ostream &os)
 {
+    int zeros = 0;
     for (int i = 0; i < aggregate.elems.len; i++)
-    {
-        koopa_raw_value_t value = reinterpret_cast<koopa_raw_value_t>(aggregate.elems.buffer[i]);
-        if (value->kind.tag == KOOPA_RVT_AGGREGATE)
-            DumpRISC(value->kind.data.aggregate, os);
-        else // value->kind.tag == KOOPA_RVT_INTEGER
-            os << ".word " << value->kind.data.integer.value << endl;
-    }
+        Init_dump(reinterpret_cast<koopa_raw_value_t>(aggregate.elems.buffer[i]), zeros, os);
+    if (zeros > 0)
+        os << ".zero " << zeros << endl;
 
     os << endl;
 }
 
+// 按字填充、复制数组的例程，用于局部数组的初始化和循环惯用法识别（见ast.cpp、idiom.cpp），只在被调用时输出
+// 参数按调用约定放在a0-a2中，n为int的个数。每次循环处理4个int，剩下的逐个处理
+static const map<string, string> word_routines = {
+    // d[k] = value
+    {"@__fill_words",
+     "li t0, 4\n"
+     "blt a2, t0, __fill_words_rest\n"
+     "__fill_words_loop:\n"
+     "sw a1, 0(a0)\n"
+     "sw a1, 4(a0)\n"
+     "sw a1, 8(a0)\n"
+     "sw a1, 12(a0)\n"
+     "addi a0, a0, 16\n"
+     "addi a2, a2, -4\n"
+     "bge a2, t0, __fill_words_loop\n"
+     "__fill_words_rest:\n"
+     "blez a2, __fill_words_end\n"
+     "sw a1, 0(a0)\n"
+     "addi a0, a0, 4\n"
+     "addi a2, a2, -1\n"
+     "j __fill_words_rest\n"
+     "__fill_words_end:\n"
+     "ret\n"},
+    // d[k] = s[k]，两段内存不重叠
+    {"@__copy_words",
+     "li t0, 4\n"
+     "blt a2, t0, __copy_words_rest\n"
+     "__copy_words_loop:\n"
+     "lw t1, 0(a1)\n"
+     "lw t2, 4(a1)\n"
+     "lw t3, 8(a1)\n"
+     "lw t4, 12(a1)\n"
+     "sw t1, 0(a0)\n"
+     "sw t2, 4(a0)\n"
+     "sw t3, 8(a0)\n"
+     "sw t4, 12(a0)\n"
+     "addi a0, a0, 16\n"
+     "addi a1, a1, 16\n"
+     "addi a2, a2, -4\n"
+     "bge a2, t0, __copy_words_loop\n"
+     "__copy_words_rest:\n"
+     "blez a2, __copy_words_end\n"
+     "lw t1, 0(a1)\n"
+     "sw t1, 0(a0)\n"
+     "addi a0, a0, 4\n"
+     "addi a1, a1, 4\n"
+     "addi a2, a2, -1\n"
+     "j __copy_words_rest\n"
+     "__copy_words_end:\n"
+     "ret\n"},
+};
+
+// 自动向量化使用的RVV 1.0例程（见vectorize.cpp），只在被调用时输出
+// 参数按调用约定放在a0-a4中，n为元素个数。每次循环由vsetvli决定本段处理的元素个数（e32，LMUL=4），
+// 归约时每段的和用vredsum累加到v8[0]中
+static const map<string, string> vector_routines = {
+    {"@__rvv_sum",
+     "vsetivli zero, 1, e32, m1, ta, ma\n"
+     "vmv.s.x v8, zero\n"
+     "blez a1, __rvv_sum_end\n"
+     "__rvv_sum_loop:\n"
+     "vsetvli t0, a1, e32, m4, ta, ma\n"
+     "vle32.v v0, (a0)\n"
+     "vredsum.vs v8, v0, v8\n"
+     "sub a1, a1, t0\n"
+     "slli t0, t0, 2\n"
+     "add a0, a0, t0\n"
+     "bnez a1, __rvv_sum_loop\n"
+     "__rvv_sum_end:\n"
+     "vmv.x.s a0, v8\n"
+     "ret\n"},
+    {"@__rvv_dot",
+     "vsetivli zero, 1, e32, m1, ta, ma\n"
+     "vmv.s.x v8, zero\n"
+     "blez a2, __rvv_dot_end\n"
+     "__rvv_dot_loop:\n"
+     "vsetvli t0, a2, e32, m4, ta, ma\n"
+     "vle32.v v0, (a0)\n"
+     "vle32.v v4, (a1)\n"
+     "vmul.vv v0, v0, v4\n"
+     "vredsum.vs v8, v0, v8\n"
+     "sub a2, a2, t0\n"
+     "slli t0, t0, 2\n"
+     "add a0, a0, t0\n"
+     "add a1, a1, t0\n"
+     "bnez a2, __rvv_dot_loop\n"
+     "__rvv_dot_end:\n"
+     "vmv.x.s a0, v8\n"
+     "ret\n"},
+    // d[k] = x[k] + a * y[k]
+    {"@__rvv_axpy",
+     "blez a4, __rvv_axpy_end\n"
+     "__rvv_axpy_loop:\n"
+     "vsetvli t0, a4, e32, m4, ta, ma\n"
+     "vle32.v v0, (a1)\n"
+     "vle32.v v4, (a2)\n"
+     "vmacc.vx v0, a3, v4\n"
+     "vse32.v v0, (a0)\n"
+     "sub a4, a4, t0\n"
+     "slli t0, t0, 2\n"
+     "add a0, a0, t0\n"
+     "add a1, a1, t0\n"
+     "add a2, a2, t0\n"
+     "bnez a4, __rvv_axpy_loop\n"
+     "__rvv_axpy_end:\n"
+     "ret\n"},
+    // d[k] = x[k] * y[k]
+    {"@__rvv_mul",
+     "blez a3, __rvv_mul_end\n"
+     "__rvv_mul_loop:\n"
+     "vsetvli t0, a3, e32, m4, ta, ma\n"
+     "vle32.v v0, (a1)\n"
+     "vle32.v v4, (a2)\n"
+     "vmul.vv v0, v0, v4\n"
+     "vse32.v v0, (a0)\n"
+     "sub a3, a3, t0\n"
+     "slli t0, t0, 2\n"
+     "add a0, a0, t0\n"
+     "add a1, a1, t0\n"
+     "add a2, a2, t0\n"
+     "bnez a3, __rvv_mul_loop\n"
+     "__rvv_mul_end:\n"
+     "ret\n"},
+    // d[k] = a * x[k] + b
+    {"@__rvv_affine",
+     "blez a4, __rvv_affine_end\n"
+     "__rvv_affine_loop:\n"
+     "vsetvli t0, a4, e32, m4, ta, ma\n"
+     "vle32.v v0, (a1)\n"
+     "vmul.vx v0, v0, a2\n"
+     "vadd.vx v0, v0, a3\n"
+     "vse32.v v0, (a0)\n"
+     "sub a4, a4, t0\n"
+     "slli t0, t0, 2\n"
+     "add a0, a0, t0\n"
+     "add a1, a1, t0\n"
+     "bnez a4, __rvv_affine_loop\n"
+     "__rvv_affine_end:\n"
+     "ret\n"},
+};
+
 // 访问函数
 void DumpRISC(const koopa_raw_function_t &func, ostream &os)
 {
-    // 跳过库函数声明
+    // 跳过库函数声明，被调用的内部例程在这里输出
     if (func->bbs.len == 0) 
+    {
+        if (!called_funcs.count(func))
+            return;
+        auto it = word_routines.find(func->name);
+        if (it != word_routines.end())
+        {
+            os << ".text" << endl;
+            os << ".globl " << 1 + func->name << endl;
+            os << 1 + func->name << ":" << endl;
+            os << it->second << endl;
+        }
+        it = vector_routines.find(func->name);
+        if (it != vector_routines.end())
+        {
+            os << ".text" << endl;
+            os << ".option push" << endl;
+            os << ".option arch, +v" << endl;
+            os << ".globl " << 1 + func->name << endl;
+            os << 1 + func->name << ":" << endl;
+            os << it->second;
+            os << ".option pop" << endl << endl;
+        }
         return;
+    }
     
     os << ".text" << endl;
     os << ".globl " << 1 + func->name << endl;
@@ -329,14 +634,79 @@ void DumpRISC(const koopa_raw_function_t &func, ostream &os)
         Store_addr_dump(ra_pos, "ra", os);
     }
 
-    DumpRISC(func->bbs, os);
+    // 先输出各基本块除最后一条跳转指令外的内容，估计每个块的位置
+    // 再根据跳转距离和块的排列顺序决定如何翻译跳转指令
+    vector<string> bodies;
+    vector<int> ends;
+    int pos = 0;
+    block_pos.clear();
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        ostringstream body;
+        DumpRISC(bb, body);
+        bodies.push_back(body.str());
+
+        // 每行汇编至多展开为两条指令（li、la、call）
+        block_pos[bb] = pos;
+        pos += 8 * count(bodies[i].begin(), bodies[i].end(), '\n');
+        ends.push_back(pos);
+        pos += TERM_SIZE;
+    }
+
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        next_bb = (i + 1 < func->bbs.len) ? reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i + 1]) : nullptr;
+        cur_end = ends[i];
+
+        os << bodies[i];
+        if (Tail_call(bb) == nullptr)
+            DumpRISC(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]), os);
+    }
 }
 
-// 访问基本块
+// 访问基本块，输出除最后一条跳转指令以外的部分
+// 跳转指令依赖块的排列，由DumpRISC(func)单独输出
+// 以尾调用结尾的块在这里直接输出尾调用，不再输出ret
 void DumpRISC(const koopa_raw_basic_block_t &bb, ostream &os)
 {
     os << bb->name + 1 << ":" << endl;
-    DumpRISC(bb->insts, os);
+    koopa_raw_value_t tail = Tail_call(bb);
+    size_t len = bb->insts.len - (tail != nullptr ? 2 : 1);
+    for (size_t i = 0; i < len; i++)
+        DumpRISC(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]), os);
+    if (tail != nullptr)
+        Tail_call_dump(tail->kind.data.call, os);
+}
+
+// 如果块以 %r = call @f(...); ret %r（或不带返回值的ret）结尾，返回这条call
+// 只有参数都能放在寄存器中时才能复用栈帧，否则第9个以后的参数会写到即将释放的栈帧里
+koopa_raw_value_t Tail_call(const koopa_raw_basic_block_t &bb)
+{
+    if (opt_options.level == 0 || !opt_options.tail_calls || bb->insts.len < 2)
+        return nullptr;
+    koopa_raw_value_t ret = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+    koopa_raw_value_t call = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 2]);
+    if (ret->kind.tag != KOOPA_RVT_RETURN || call->kind.tag != KOOPA_RVT_CALL)
+        return nullptr;
+    if (ret->kind.data.ret.value != nullptr && ret->kind.data.ret.value != call)
+        return nullptr;
+
+    auto &args = call->kind.data.call.args;
+    if (args.len > 8)
+        return nullptr;
+    // 参数本身在a0-a7中，依次设置实参时可能被覆盖；
+    // 指向本函数局部数组的实参在栈帧释放后就失效了
+    for (size_t i = 0; i < args.len; i++)
+    {
+        koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        if (arg->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+            return nullptr;
+        if (arg->ty->tag == KOOPA_RTT_POINTER && Mem_base(arg)->kind.tag == KOOPA_RVT_ALLOC)
+            return nullptr;
+    }
+    return call;
 }
 
 
@@ -423,7 +793,14 @@ void DumpRISC(const koopa_raw_return_t &ret, string reg, ostream &os)
     {
         Load_addr_dump(ret.value, "a0", os);
     }
-    
+
+    Epilogue_dump(os);
+    os << "ret" << endl;
+}
+
+// 函数返回前恢复ra和栈指针
+void Epilogue_dump(ostream &os)
+{
     // 恢复ra寄存器
     if (rstack.R_size != 0)
     {
@@ -444,16 +821,14 @@ void DumpRISC(const koopa_raw_return_t &ret, string reg, ostream &os)
         os << "li t0, " << stack_size << endl;
         os << "add sp, sp, t0" << endl;
     }
-
-    os << "ret" << endl;
 }
 
 // load
 void DumpRISC(const koopa_raw_load_t &load, ostream &os)
 {
     auto &src = load.src;
-    // 如果是这两种类型，需要先从栈上取出地址，再load该地址
-    if (src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || src->kind.tag == KOOPA_RVT_GET_PTR)
+    // 如果不是alloc或全局变量，src是一个存在栈上的地址（getelemptr、getptr或load出的指针），需要先取出地址，再load该地址
+    if (src->kind.tag != KOOPA_RVT_ALLOC && src->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
     {
         Load_addr_dump(src, "t5", os); // t5中存着真正需要被load的地址
         os << "lw t0, 0(t5)" << endl; // t0中存着得到的值
@@ -467,8 +842,8 @@ void DumpRISC(const koopa_raw_store_t &store, ostream &os)
 {
     auto &dest = store.dest;
     auto &value = store.value;
-    // 如果是这两种类型，需要先从栈上取出地址，再存入该地址
-    if (dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR || dest->kind.tag == KOOPA_RVT_GET_PTR)
+    // 同load，先从栈上取出地址，再存入该地址
+    if (dest->kind.tag != KOOPA_RVT_ALLOC && dest->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
     {
         Load_addr_dump(value, "t0", os); // t0中存着要被store的值
         Load_addr_dump(dest, "t5", os); // t5中存着真正的目标地址
@@ -481,31 +856,69 @@ void DumpRISC(const koopa_raw_store_t &store, ostream &os)
     
 }
 
-// branch
-void DumpRISC(const koopa_raw_branch_t &branch, ostream &os)
+// 当前块末尾的跳转指令能否直接到达target
+bool Near(koopa_raw_basic_block_t target, int range)
+{
+    return abs(block_pos[target] - cur_end) + TERM_SIZE < range;
+}
+
+// 无条件跳转，不考虑顺序执行
+void Far_jump_dump(koopa_raw_basic_block_t target, ostream &os)
 {
+    if (Near(target, JUMP_RANGE))
+        os << "j " << target->name + 1 << endl;
+
     // 实现间接跳转
-    Load_addr_dump(branch.cond, "t0", os);
-    os << "bnez t0, new_branch_true_" << new_branch_num << endl;
-    os << "j new_branch_false_" << new_branch_num << endl;
+    else 
+    {
+        os << "la t0, "  << target->name + 1 << endl;
+        os << "jalr t0, t0, 0" << endl;
+    }
+}
+
+// 无条件跳转。如果target紧随当前块之后，顺序执行即可
+void Jump_dump(koopa_raw_basic_block_t target, ostream &os)
+{
+    if (target != next_bb)
+        Far_jump_dump(target, os);
+}
+
+// 条件跳转：op为bnez或beqz
+// 距离太远时，用相反条件的短跳转越过一条长跳转
+void Cond_jump_dump(string op, string reg, koopa_raw_basic_block_t target, ostream &os)
+{
+    if (Near(target, BRANCH_RANGE))
+    {
+        os << op << " " << reg << ", " << target->name + 1 << endl;
+        return;
+    }
 
-    os << "new_branch_true_" << new_branch_num << ":" << endl;
-    os << "la t0, " << branch.true_bb->name + 1 << endl;
-    os << "jalr t0, t0, 0" << endl;
+    string inv_op = (op == "bnez") ? "beqz" : "bnez";
+    int num = new_branch_num++;
+    os << inv_op << " " << reg << ", new_branch_" << num << endl;
+    Far_jump_dump(target, os);
+    os << "new_branch_" << num << ":" << endl;
+}
 
-    os << "new_branch_false_" << new_branch_num << ":" << endl;
-    os << "la t0, " << branch.false_bb->name + 1 << endl;
-    os << "jalr t0, t0, 0" << endl;
+// branch
+void DumpRISC(const koopa_raw_branch_t &branch, ostream &os)
+{
+    Load_addr_dump(branch.cond, "t0", os);
 
-    new_branch_num++;
+    // true分支紧随其后，只需在条件不成立时跳转
+    if (branch.true_bb == next_bb)
+        Cond_jump_dump("beqz", "t0", branch.false_bb, os);
+    else 
+    {
+        Cond_jump_dump("bnez", "t0", branch.true_bb, os);
+        Jump_dump(branch.false_bb, os);
+    }
 }
 
 // jump
 void DumpRISC(const koopa_raw_jump_t &jump, ostream &os)
 {
-    // 实现间接跳转
-    os << "la t0, "  << jump.target->name + 1 << endl;
-    os << "jalr t0, t0, 0" << endl;
+    Jump_dump(jump.target, os);
 }
 
 // call
@@ -536,6 +949,19 @@ void DumpRISC(const koopa_raw_call_t &call, ostream &os)
     // 把返回值保存到call指令对应的内存中
 }
 
+// 尾调用：参数放入寄存器后释放当前栈帧，直接跳到被调用者，由它返回到当前函数的调用者
+void Tail_call_dump(const koopa_raw_call_t &call, ostream &os)
+{
+    for (int i = 0; i < call.args.len; i++)
+    {
+        koopa_raw_value_t value = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+        Load_addr_dump(value, "a" + to_string(i), os);
+    }
+
+    Epilogue_dump(os);
+    os << "tail " << call.callee->name + 1 << endl;
+}
+
 // getelemptr
 void DumpRISC(const koopa_raw_get_elem_ptr_t &getelemptr, const koopa_raw_value_t &value, ostream &os)
 {
@@ -568,13 +994,7 @@ void DumpRISC(const koopa_raw_get_elem_ptr_t &getelemptr, const koopa_raw_value_
     
     // 到此，基地址存放在t0中
     
-    Load_addr_dump(index, "t1", os); // index存放在t1中
-
-    int size = Ptr_size(value->ty); // 一个单元的长度
-    os << "li t2" << ", " << size << endl; // size存放在t2中
-
-    os << "mul t1, t1, t2" << endl;
-    os << "add t0, t0, t1" << endl;
+    Index_dump(index, Ptr_size(value->ty), os);
 
     // 存放结果
     Store_addr_dump(value, "t0", os);
@@ -612,18 +1032,49 @@ void DumpRISC(const koopa_raw_get_ptr_t &getptr, const koopa_raw_value_t &value,
     
     // 到此，基地址存放在t0中
     
-    Load_addr_dump(index, "t1", os); // index存放在t1中
-
-    int size = Ptr_size(value->ty); // 一个单元的长度
-    os << "li t2" << ", " << size << endl; // size存放在t2中
-
-    os << "mul t1, t1, t2" << endl;
-    os << "add t0, t0, t1" << endl;
+    Index_dump(index, Ptr_size(value->ty), os);
 
     // 存放结果
     Store_addr_dump(value, "t0", os);
 }
 
+// 把 index * size 加到t0上（t0中存放基地址）
+// 下标是常数时直接算出偏移量，单元长度是2的幂时用移位代替乘法
+void Index_dump(const koopa_raw_value_t &index, int size, ostream &os)
+{
+    if (index->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        int offset = index->kind.data.integer.value * size;
+        if (offset == 0)
+            return;
+        if (offset >= -2048 && offset < 2048)
+            os << "addi t0, t0, " << offset << endl;
+        else 
+        {
+            os << "li t1, " << offset << endl;
+            os << "add t0, t0, t1" << endl;
+        }
+        return;
+    }
+
+    Load_addr_dump(index, "t1", os); // index存放在t1中
+
+    int shift = 0;
+    while ((1 << shift) < size)
+        shift++;
+    if ((1 << shift) == size)
+    {
+        if (shift > 0)
+            os << "slli t1, t1, " << shift << endl;
+    }
+    else 
+    {
+        os << "li t2" << ", " << size << endl; // size存放在t2中
+        os << "mul t1, t1, t2" << endl;
+    }
+    os << "add t0, t0, t1" << endl;
+}
+
 // 检查指令是否已分配寄存器
 void CheckReg(const koopa_raw_value_t &value)
 {
@@ -738,6 +1189,15 @@ void DumpRISC(const koopa_raw_binary_t &binary, ostream &os)
 {
     // 将lhs load 到 t0 中，rhs load 到 t1 中
     Load_addr_dump(binary.lhs, "t0", os);
+
+    // 除数是非零常数时不使用div/rem
+    bool div_op = binary.op == KOOPA_RBO_DIV || binary.op == KOOPA_RBO_MOD;
+    if (div_op && binary.rhs->kind.tag == KOOPA_RVT_INTEGER && binary.rhs->kind.data.integer.value != 0)
+    {
+        Div_const_dump(binary.rhs->kind.data.integer.value, binary.op == KOOPA_RBO_MOD, os);
+        return;
+    }
+
     Load_addr_dump(binary.rhs, "t1", os);
 
 
@@ -813,4 +1273,115 @@ void DumpRISC(const koopa_raw_binary_t &binary, ostream &os)
 
     // store
     // os << "sw t0, " << stack.offset[value] << "(sp)" << endl;
-}
\ No newline at end of file
+}
+
+// 有符号除以常数所用的魔数和移位量（Hacker's Delight 10-1）
+// 要求 2 <= |d| < 2^31
+void Div_magic(int d, int &magic, int &shift)
+{
+    const unsigned two31 = 0x80000000;
+    unsigned ad = d < 0 ? -(unsigned)d : d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    int p = 31;
+    do
+    {
+        p++;
+        q1 = 2 * q1; r1 = 2 * r1;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 = 2 * q2; r2 = 2 * r2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    magic = (int)(q2 + 1);
+    if (d < 0)
+        magic = -magic;
+    shift = p - 32;
+}
+
+// t0 = t0 / d 或 t0 % d（is_mod），结果与C的截断除法一致，使用t1、t2作为临时寄存器
+// 2的幂用移位并修正负数的舍入方向，其余常数用mulh乘以魔数
+void Div_const_dump(int d, bool is_mod, ostream &os)
+{
+    unsigned ad = d < 0 ? -(unsigned)d : d;
+
+    if (ad == 1)
+    {
+        if (is_mod)
+            os << "li t0, 0" << endl;
+        else if (d < 0)
+            os << "neg t0, t0" << endl;
+        return;
+    }
+
+    // d = INT_MIN：只有被除数也是INT_MIN时商为1
+    if (d == INT_MIN)
+    {
+        os << "li t1, " << INT_MIN << endl;
+        os << "xor t1, t0, t1" << endl;
+        os << "seqz t1, t1" << endl;
+        if (is_mod)
+        {
+            os << "slli t1, t1, 31" << endl;
+            os << "sub t0, t0, t1" << endl;
+        }
+        else os << "mv t0, t1" << endl;
+        return;
+    }
+
+    // |d| = 2^k：负数先加上 2^k - 1，使算术右移向0舍入
+    if ((ad & (ad - 1)) == 0)
+    {
+        int k = 0;
+        while ((1u << k) < ad)
+            k++;
+        os << "srai t1, t0, 31" << endl;
+        os << "srli t1, t1, " << 32 - k << endl;
+        os << "add t1, t0, t1" << endl;
+        if (is_mod)
+        {
+            // t0 - (t1 & -2^k)
+            if (k <= 11)
+                os << "andi t1, t1, " << -(1 << k) << endl;
+            else
+            {
+                os << "li t2, " << -(1 << k) << endl;
+                os << "and t1, t1, t2" << endl;
+            }
+            os << "sub t0, t0, t1" << endl;
+        }
+        else
+        {
+            os << "srai t0, t1, " << k << endl;
+            if (d < 0)
+                os << "neg t0, t0" << endl;
+        }
+        return;
+    }
+
+    int magic, shift;
+    Div_magic(d, magic, shift);
+    os << "li t1, " << magic << endl;
+    os << "mulh t1, t0, t1" << endl;
+    if (d > 0 && magic < 0)
+        os << "add t1, t1, t0" << endl;
+    else if (d < 0 && magic > 0)
+        os << "sub t1, t1, t0" << endl;
+    if (shift > 0)
+        os << "srai t1, t1, " << shift << endl;
+    // 商为负数时加1，向0舍入
+    os << "srli t2, t1, 31" << endl;
+    os << "add t1, t1, t2" << endl;
+
+    if (is_mod)
+    {
+        os << "li t2, " << d << endl;
+        os << "mul t1, t1, t2" << endl;
+        os << "sub t0, t0, t1" << endl;
+    }
+    else os << "mv t0, t1" << endl;
+}
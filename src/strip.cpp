@@ -0,0 +1,56 @@
+#include "inc/opt.hpp"
+
+// 删除无用的函数和全局变量
+// 从main出发沿调用图找到所有可能被调用的函数（包括库函数声明），其余函数不再输出；
+// 内联、特化之后原来的函数往往已经没有调用者。剩下的函数中没有被引用的全局变量也一并删除
+// 没有被调用的库函数声明也删除；后面的优化需要后端例程时用Routine_decl重新加入声明
+void Strip_dead(Program_IR *prog)
+{
+    map<koopa_raw_function_t, Func_IR *> func_of;
+    Func_IR *main_func = nullptr;
+    for (Func_IR *func : prog->funcs)
+    {
+        func_of[func->func] = func;
+        if (string(func->func->name) == "@main")
+            main_func = func;
+    }
+    if (main_func == nullptr)
+        return;
+
+    set<Func_IR *> reachable;
+    set<koopa_raw_value_t> used_globals;
+    vector<Func_IR *> work(1, main_func);
+    reachable.insert(main_func);
+    while (!work.empty())
+    {
+        Func_IR *func = work.back();
+        work.pop_back();
+        for (Block_IR *block : func->blocks)
+            for (auto inst : block->insts)
+            {
+                for (auto op : Operands(inst))
+                    if ((*op)->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                        used_globals.insert(*op);
+                if (inst->kind.tag != KOOPA_RVT_CALL)
+                    continue;
+                Func_IR *callee = func_of[inst->kind.data.call.callee];
+                if (!reachable.count(callee))
+                {
+                    reachable.insert(callee);
+                    work.push_back(callee);
+                }
+            }
+    }
+
+    vector<Func_IR *> funcs;
+    for (Func_IR *func : prog->funcs)
+        if (reachable.count(func))
+            funcs.push_back(func);
+    prog->funcs = funcs;
+
+    vector<koopa_raw_value_t> values;
+    for (auto value : prog->values)
+        if (used_globals.count(value))
+            values.push_back(value);
+    prog->values = values;
+}
@@ -0,0 +1,83 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+
+// block是否以 %r = call @自身(...); ret %r 结尾（无返回值时为 call; ret）
+static bool Is_self_tail_call(Func_IR *func, Block_IR *block)
+{
+    size_t n = block->insts.size();
+    if (n < 2)
+        return false;
+    koopa_raw_value_t ret = block->insts[n - 1], call = block->insts[n - 2];
+    if (ret->kind.tag != KOOPA_RVT_RETURN || call->kind.tag != KOOPA_RVT_CALL)
+        return false;
+    if (call->kind.data.call.callee != func->func)
+        return false;
+    // 实参指向本函数的局部数组时，复用栈帧后被调用者读到的是已经被覆盖的数组
+    auto &args = call->kind.data.call.args;
+    for (size_t i = 0; i < args.len; i++)
+    {
+        koopa_raw_value_t arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        if (arg->ty->tag == KOOPA_RTT_POINTER && Mem_base(arg)->kind.tag == KOOPA_RVT_ALLOC)
+            return false;
+    }
+    return ret->kind.data.ret.value == nullptr || ret->kind.data.ret.value == call;
+}
+
+// 尾递归消除（tail recursion elimination）
+// 参数改为存放在局部变量中，原来的入口块成为循环头；
+// 尾递归调用改为把实参存入这些变量后跳回循环头，不再占用新的栈帧
+void Tail_recursion(Func_IR *func)
+{
+    vector<Block_IR *> tails;
+    for (Block_IR *block : func->blocks)
+        if (Is_self_tail_call(func, block))
+            tails.push_back(block);
+    if (tails.empty())
+        return;
+
+    Block_IR *header = func->blocks[0];
+    Block_IR *entry = New_block("tail_entry");
+
+    // 所有局部变量移到新的入口块，循环中不再重复分配
+    for (Block_IR *block : func->blocks)
+    {
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+                entry->insts.push_back(inst);
+            else remain.push_back(inst);
+        }
+        block->insts = remain;
+    }
+
+    // 循环头中从变量读出参数，函数中对参数的使用都改为使用读出的值
+    auto &params = func->func->params;
+    vector<koopa_raw_value_t> vars, loads;
+    for (size_t i = 0; i < params.len; i++)
+    {
+        koopa_raw_value_t param = reinterpret_cast<koopa_raw_value_t>(params.buffer[i]);
+        koopa_raw_value_t var = New_alloc(param->ty, "tail_param");
+        koopa_raw_value_t load = New_load(var);
+        Replace_uses(func, param, load);
+        vars.push_back(var);
+        loads.push_back(load);
+
+        entry->insts.push_back(var);
+        entry->insts.push_back(New_store(param, var));
+    }
+    entry->insts.push_back(New_jump(header));
+    header->insts.insert(header->insts.begin(), loads.begin(), loads.end());
+
+    for (Block_IR *block : tails)
+    {
+        koopa_raw_value_t call = block->insts[block->insts.size() - 2];
+        block->insts.resize(block->insts.size() - 2);
+        auto &args = call->kind.data.call.args;
+        for (size_t i = 0; i < args.len; i++)
+            block->insts.push_back(New_store(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), vars[i]));
+        block->insts.push_back(New_jump(header));
+    }
+
+    func->blocks.insert(func->blocks.begin(), entry);
+}
@@ -0,0 +1,339 @@
+#include "inc/opt.hpp"
+#include <algorithm>
+#include <climits>
+
+#define UNROLL_BUDGET 240 // 部分展开后循环中指令数的上限
+#define FULL_UNROLL_BUDGET 320 // 完全展开后指令数的上限
+#define MAX_TRIP_COUNT 64 // 完全展开时最多的迭代次数
+
+static bool Defined_in(Func_IR *func, Loop *loop, koopa_raw_value_t value)
+{
+    auto it = func->def_block.find(value);
+    return it != func->def_block.end() && loop->Contains(it->second);
+}
+
+// 交换比较运算的两个操作数后对应的运算
+static koopa_raw_binary_op_t Swap_op(koopa_raw_binary_op_t op)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_LT: return KOOPA_RBO_GT;
+    case KOOPA_RBO_GT: return KOOPA_RBO_LT;
+    case KOOPA_RBO_LE: return KOOPA_RBO_GE;
+    case KOOPA_RBO_GE: return KOOPA_RBO_LE;
+    default: return op;
+    }
+}
+
+static bool Compare(koopa_raw_binary_op_t op, long long a, long long b)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_LT: return a < b;
+    case KOOPA_RBO_GT: return a > b;
+    case KOOPA_RBO_LE: return a <= b;
+    case KOOPA_RBO_GE: return a >= b;
+    default: assert(false);
+    }
+    return false;
+}
+
+static int Loop_size(Loop *loop)
+{
+    int size = 0;
+    for (Block_IR *block : loop->blocks)
+        size += block->insts.size();
+    return size;
+}
+
+// 判断loop是否是计数循环。只处理只从latch退出的循环
+bool Analyze_loop(Func_IR *func, Loop *loop, Counted_loop &info)
+{
+    if (loop->latches.size() != 1)
+        return false;
+    Block_IR *latch = loop->latches[0];
+    vector<Block_IR *> exiting = loop->Exiting_blocks();
+    if (exiting.size() != 1 || exiting[0] != latch)
+        return false;
+
+    koopa_raw_value_t term = latch->Terminator();
+    if (term->kind.tag != KOOPA_RVT_BRANCH || term->kind.data.branch.true_bb != loop->header->bb)
+        return false;
+    koopa_raw_value_t cond = term->kind.data.branch.cond;
+    if (cond->kind.tag != KOOPA_RVT_BINARY || func->def_block[cond] != latch)
+        return false;
+
+    // 循环中定义的值不能在循环外被使用，否则复制循环体后无法确定使用哪一份
+    for (Block_IR *block : func->blocks)
+        if (!loop->Contains(block))
+            for (auto inst : block->insts)
+                for (auto op : Operands(inst))
+                    if (Defined_in(func, loop, *op))
+                        return false;
+
+    auto &cmp = cond->kind.data.binary;
+    for (auto &iv : Find_induction_vars(func, loop))
+    {
+        if (iv.steps.size() != 1 || iv.steps.begin()->second == 0)
+            continue;
+        koopa_raw_value_t store = iv.steps.begin()->first;
+        int step = iv.steps.begin()->second;
+
+        koopa_raw_value_t load;
+        bool iv_left;
+        if (cmp.lhs->kind.tag == KOOPA_RVT_LOAD && cmp.lhs->kind.data.load.src == iv.var)
+            load = cmp.lhs, iv_left = true;
+        else if (cmp.rhs->kind.tag == KOOPA_RVT_LOAD && cmp.rhs->kind.data.load.src == iv.var)
+            load = cmp.rhs, iv_left = false;
+        else continue;
+
+        koopa_raw_value_t bound = iv_left ? cmp.rhs : cmp.lhs;
+        if (Defined_in(func, loop, bound))
+            continue;
+
+        // 只处理单调趋向边界的比较
+        koopa_raw_binary_op_t op = iv_left ? cmp.op : Swap_op(cmp.op);
+        bool up = (op == KOOPA_RBO_LT || op == KOOPA_RBO_LE) && step > 0;
+        bool down = (op == KOOPA_RBO_GT || op == KOOPA_RBO_GE) && step < 0;
+        if (!up && !down)
+            continue;
+
+        // 比较读到的必须是本次迭代更新后的i：store所在的块支配latch，且在同一块时位于load之前
+        Block_IR *store_block = func->def_block[store];
+        if (func->def_block[load] != latch || !func->Dominates(store_block, latch))
+            continue;
+        if (store_block == latch)
+        {
+            auto store_pos = find(latch->insts.begin(), latch->insts.end(), store);
+            auto load_pos = find(latch->insts.begin(), latch->insts.end(), load);
+            if (store_pos > load_pos)
+                continue;
+        }
+
+        info.latch = latch;
+        info.store = store;
+        info.exit = func->block_map[term->kind.data.branch.false_bb];
+        info.var = iv.var;
+        info.step = step;
+        info.cond = cond;
+        info.iv_left = iv_left;
+        info.op = op;
+        info.bound = bound;
+        return true;
+    }
+    return false;
+}
+
+// 进入循环时归纳变量的初值：从preheader沿唯一前驱向上，找到最近的一次store
+bool Find_init(Loop *loop, koopa_raw_value_t var, int &init)
+{
+    Block_IR *block = loop->preheader;
+    for (int depth = 0; depth < 8; depth++)
+    {
+        for (size_t i = block->insts.size(); i-- > 0; )
+        {
+            koopa_raw_value_t inst = block->insts[i];
+            if (inst->kind.tag != KOOPA_RVT_STORE || inst->kind.data.store.dest != var)
+                continue;
+            if (!Is_const(inst->kind.data.store.value))
+                return false;
+            init = inst->kind.data.store.value->kind.data.integer.value;
+            return true;
+        }
+        if (block->preds.size() != 1)
+            return false;
+        block = block->preds[0];
+    }
+    return false;
+}
+
+// 迭代次数，超过MAX_TRIP_COUNT时返回-1
+static int Trip_count(const Counted_loop &info, int init, int bound)
+{
+    long long i = init;
+    for (int count = 1; count <= MAX_TRIP_COUNT; count++)
+    {
+        i += info.step;
+        if (i > INT_MAX || i < INT_MIN)
+            return -1;
+        if (!Compare(info.op, i, bound))
+            return count;
+    }
+    return -1;
+}
+
+// 按原来的顺序排列的循环中的块
+static vector<Block_IR *> Loop_body(Func_IR *func, Loop *loop)
+{
+    vector<Block_IR *> body;
+    for (Block_IR *block : func->blocks)
+        if (loop->Contains(block))
+            body.push_back(block);
+    return body;
+}
+
+// 把循环中的alloc移到入口块，避免复制循环体时重复分配栈空间
+static void Hoist_allocs(Func_IR *func, const vector<Block_IR *> &body)
+{
+    vector<koopa_raw_value_t> allocs;
+    for (Block_IR *block : body)
+    {
+        vector<koopa_raw_value_t> remain;
+        for (auto inst : block->insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+                allocs.push_back(inst);
+            else remain.push_back(inst);
+        }
+        block->insts = remain;
+    }
+    Block_IR *entry = func->blocks[0];
+    entry->insts.insert(entry->insts.begin(), allocs.begin(), allocs.end());
+}
+
+// 复制count份循环体，第k份的latch直接跳到第k+1份的header
+// 返回所有副本的块；最后一份latch的跳转指令由调用者修改
+static vector<Block_IR *> Clone_copies(const vector<Block_IR *> &body, Block_IR *header, Block_IR *latch, int count,
+                                       Block_IR *&first_header, Block_IR *&last_latch)
+{
+    size_t header_pos = find(body.begin(), body.end(), header) - body.begin();
+    size_t latch_pos = find(body.begin(), body.end(), latch) - body.begin();
+
+    vector<Block_IR *> copies;
+    last_latch = nullptr;
+    for (int k = 0; k < count; k++)
+    {
+        map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+        vector<Block_IR *> copy = Clone_blocks(body, value_map);
+        if (k == 0)
+            first_header = copy[header_pos];
+        else last_latch->insts.back() = New_jump(copy[header_pos]);
+        last_latch = copy[latch_pos];
+        copies.insert(copies.end(), copy.begin(), copy.end());
+    }
+    return copies;
+}
+
+// 在block末尾加入判断 i op bound 的条件跳转，guard不为空时还要求guard成立
+static void Append_test(Block_IR *block, const Counted_loop &info, koopa_raw_value_t bound, Block_IR *true_block, Block_IR *false_block,
+                        koopa_raw_value_t guard = nullptr)
+{
+    koopa_raw_value_t load = New_load(info.var);
+    auto op = info.cond->kind.data.binary.op;
+    koopa_raw_value_t cond = info.iv_left ? New_binary(op, load, bound) : New_binary(op, bound, load);
+    block->insts.push_back(load);
+    block->insts.push_back(cond);
+    if (guard != nullptr)
+        block->insts.push_back(cond = New_binary(KOOPA_RBO_AND, guard, cond));
+    block->insts.push_back(New_branch(cond, true_block, false_block));
+}
+
+// 用blocks替换函数中原来的循环
+static void Replace_body(Func_IR *func, const vector<Block_IR *> &body, const vector<Block_IR *> &blocks)
+{
+    auto pos = find(func->blocks.begin(), func->blocks.end(), body[0]);
+    pos = func->blocks.insert(pos, blocks.begin(), blocks.end()) + blocks.size();
+    set<Block_IR *> removed(body.begin(), body.end());
+    func->blocks.erase(remove_if(pos, func->blocks.end(), [&](Block_IR *block) {
+        return removed.count(block) != 0;
+    }), func->blocks.end());
+}
+
+// 完全展开：迭代次数已知且不多时，把循环体复制trip份，去掉所有条件判断
+static void Full_unroll(Func_IR *func, Loop *loop, const Counted_loop &info, int trip)
+{
+    vector<Block_IR *> body = Loop_body(func, loop);
+    Block_IR *first_header, *last_latch;
+    vector<Block_IR *> copies = Clone_copies(body, loop->header, info.latch, trip, first_header, last_latch);
+
+    last_latch->insts.back() = New_jump(info.exit);
+    Replace_target(loop->preheader->Terminator(), loop->header, first_header);
+    Replace_body(func, body, copies);
+}
+
+// 部分展开：每次迭代执行factor份循环体，只在最后一份之后判断一次
+// 进入展开后的循环前要求 i + (factor - 1) * step op bound，即剩下的迭代至少还有factor次；
+// 不足factor次的部分由原来的循环（余数循环）完成
+// 边界不是常数时，bound - (factor - 1) * step可能溢出，在进入展开后的循环前判断：
+// step > 0 时要求 bound >= INT_MIN + delta，step < 0 时要求 bound <= INT_MAX + delta，否则直接执行余数循环
+static bool Partial_unroll(Func_IR *func, Loop *loop, const Counted_loop &info, int factor)
+{
+    long long delta = (long long)(factor - 1) * info.step;
+    if (delta > INT_MAX || delta < INT_MIN)
+        return false;
+    koopa_raw_value_t bound, guard = nullptr;
+    Block_IR *preheader = loop->preheader;
+    preheader->insts.pop_back();
+    if (Is_const(info.bound))
+    {
+        long long value = info.bound->kind.data.integer.value - delta;
+        if (value > INT_MAX || value < INT_MIN)
+        {
+            preheader->insts.push_back(New_jump(loop->header));
+            return false;
+        }
+        bound = New_integer(value);
+    }
+    else
+    {
+        bound = New_binary(KOOPA_RBO_SUB, info.bound, New_integer(delta));
+        if (delta > 0)
+            guard = New_binary(KOOPA_RBO_GE, info.bound, New_integer(INT_MIN + delta));
+        else guard = New_binary(KOOPA_RBO_LE, info.bound, New_integer(INT_MAX + delta));
+        preheader->insts.push_back(bound);
+        preheader->insts.push_back(guard);
+    }
+
+    vector<Block_IR *> body = Loop_body(func, loop);
+    Block_IR *first_header, *last_latch;
+    vector<Block_IR *> copies = Clone_copies(body, loop->header, info.latch, factor, first_header, last_latch);
+
+    // 余数循环的入口：原来的循环是do-while形式，进入前需要先判断一次
+    Block_IR *rem_entry = New_block("unroll_remain");
+    Append_test(rem_entry, info, info.bound, loop->header, info.exit);
+
+    last_latch->insts.pop_back();
+    Append_test(last_latch, info, bound, first_header, rem_entry);
+    Append_test(preheader, info, bound, first_header, rem_entry, guard);
+
+    copies.push_back(rem_entry);
+    auto pos = find(func->blocks.begin(), func->blocks.end(), body[0]);
+    func->blocks.insert(pos, copies.begin(), copies.end());
+    return true;
+}
+
+// 循环展开（loop unrolling）
+// 只展开最内层的计数循环：迭代次数为较小的常数时完全展开，否则按unroll_factor部分展开
+// 展开后的循环体大小受UNROLL_BUDGET和FULL_UNROLL_BUDGET限制
+void Unroll(Func_IR *func)
+{
+    Build_CFG(func);
+    Find_loops(func);
+
+    for (Loop *loop : func->loops)
+    {
+        Build_CFG(func);
+        Counted_loop info;
+        if (!loop->children.empty() || !Analyze_loop(func, loop, info))
+            continue;
+
+        int size = Loop_size(loop);
+        int init, trip = -1;
+        Insert_preheader(func, loop);
+        if (Is_const(info.bound) && Find_init(loop, info.var, init))
+            trip = Trip_count(info, init, info.bound->kind.data.integer.value);
+
+        bool full = trip > 0 && trip * size <= FULL_UNROLL_BUDGET;
+        bool partial = opt_options.unroll_factor > 1 && size * opt_options.unroll_factor <= UNROLL_BUDGET;
+        if (!full && !partial)
+            continue;
+
+        Hoist_allocs(func, Loop_body(func, loop));
+        if (full)
+            Full_unroll(func, loop, info, trip);
+        else Partial_unroll(func, loop, info, opt_options.unroll_factor);
+    }
+
+    Remove_unused(func);
+    Build_CFG(func);
+}
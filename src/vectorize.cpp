@@ -0,0 +1,340 @@
+#include "inc/opt.hpp"
+
+#define VECTOR_MIN_TRIP 8 // 迭代次数已知且少于该值时不向量化
+
+// 后端用RVV实现的例程（riscv.cpp），参数中p表示*i32，i表示i32
+enum Vector_kind
+{
+    VEC_SUM, // s += sum(x[0..n))
+    VEC_DOT, // s += sum(x[k] * y[k])
+    VEC_AXPY, // d[k] = x[k] + a * y[k]
+    VEC_MUL, // d[k] = x[k] * y[k]
+    VEC_AFFINE, // d[k] = a * x[k] + b
+};
+
+struct Vector_routine
+{
+    const char *name;
+    const char *params;
+    bool ret_int;
+};
+
+static const Vector_routine vector_routines[] = {
+    {"@__rvv_sum", "pi", true},
+    {"@__rvv_dot", "ppi", true},
+    {"@__rvv_axpy", "pppii", false},
+    {"@__rvv_mul", "pppi", false},
+    {"@__rvv_affine", "ppiii", false},
+};
+
+// 可以向量化的循环：只有一个块，每次迭代执行一次归约 s = s + e 或逐元素的 d[i] = e
+struct Vector_loop
+{
+    Loop *loop;
+    Counted_loop info;
+    Vector_kind kind;
+    koopa_raw_value_t store; // 对s或d[i]的store
+    koopa_raw_value_t x, y; // 读取的数组元素的地址，不用的为nullptr
+    koopa_raw_value_t a, b; // 与i无关的标量
+    bool negate_a, negate_b; // 减法：使用 -a 或 -b
+};
+
+static bool Defined_in(Func_IR *func, Loop *loop, koopa_raw_value_t value)
+{
+    auto it = func->def_block.find(value);
+    return it != func->def_block.end() && loop->Contains(it->second);
+}
+
+static bool Is_load_of(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    return value->kind.tag == KOOPA_RVT_LOAD && value->kind.data.load.src == var;
+}
+
+static bool Uses_var(koopa_raw_value_t value, koopa_raw_value_t var)
+{
+    if (Is_load_of(value, var))
+        return true;
+    for (auto op : Operands(value))
+        if (Uses_var(*op, var))
+            return true;
+    return false;
+}
+
+static bool Is_binary(koopa_raw_value_t value, koopa_raw_binary_op_t op)
+{
+    return value->kind.tag == KOOPA_RVT_BINARY && value->kind.data.binary.op == op;
+}
+
+// 循环中对x[i + k]的load
+static bool Is_element(Func_IR *func, const Vector_loop &vec, koopa_raw_value_t value)
+{
+    return value->kind.tag == KOOPA_RVT_LOAD && Defined_in(func, vec.loop, value) && Is_unit_stride(value->kind.data.load.src, vec.info.var);
+}
+
+// value = a * x[i + k]，a与i无关（没有乘法时a为1）
+static bool Match_scaled(Func_IR *func, const Vector_loop &vec, koopa_raw_value_t value, koopa_raw_value_t &x, koopa_raw_value_t &a)
+{
+    koopa_raw_value_t var = vec.info.var;
+    if (Is_element(func, vec, value))
+    {
+        x = value->kind.data.load.src;
+        a = New_integer(1);
+        return true;
+    }
+    if (!Is_binary(value, KOOPA_RBO_MUL))
+        return false;
+    auto &bin = value->kind.data.binary;
+    if (Is_element(func, vec, bin.lhs) && !Uses_var(bin.rhs, var))
+        x = bin.lhs->kind.data.load.src, a = bin.rhs;
+    else if (Is_element(func, vec, bin.rhs) && !Uses_var(bin.lhs, var))
+        x = bin.rhs->kind.data.load.src, a = bin.lhs;
+    else return false;
+    return true;
+}
+
+// 归约 s = s + x[i] 或 s = s + x[i] * y[i]，s是局部标量
+static bool Match_reduction(Func_IR *func, Vector_loop &vec)
+{
+    koopa_raw_value_t dest = vec.store->kind.data.store.dest;
+    koopa_raw_value_t value = vec.store->kind.data.store.value;
+    if (dest->kind.tag != KOOPA_RVT_ALLOC || dest->ty->data.pointer.base->tag != KOOPA_RTT_INT32 || !Is_binary(value, KOOPA_RBO_ADD))
+        return false;
+    koopa_raw_value_t lhs = value->kind.data.binary.lhs, rhs = value->kind.data.binary.rhs;
+    koopa_raw_value_t term = Is_load_of(lhs, dest) ? rhs : Is_load_of(rhs, dest) ? lhs : nullptr;
+    if (term == nullptr)
+        return false;
+
+    if (Is_element(func, vec, term))
+    {
+        vec.kind = VEC_SUM;
+        vec.x = term->kind.data.load.src;
+        return true;
+    }
+    if (Is_binary(term, KOOPA_RBO_MUL) && Is_element(func, vec, term->kind.data.binary.lhs) && Is_element(func, vec, term->kind.data.binary.rhs))
+    {
+        vec.kind = VEC_DOT;
+        vec.x = term->kind.data.binary.lhs->kind.data.load.src;
+        vec.y = term->kind.data.binary.rhs->kind.data.load.src;
+        return true;
+    }
+    return false;
+}
+
+// 逐元素运算 d[i] = x[i] * y[i]、x[i] ± a * y[i]、a * x[i] ± b
+static bool Match_elementwise(Func_IR *func, Vector_loop &vec)
+{
+    koopa_raw_value_t var = vec.info.var;
+    koopa_raw_value_t value = vec.store->kind.data.store.value;
+    if (!Is_unit_stride(vec.store->kind.data.store.dest, var) || value->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    auto &bin = value->kind.data.binary;
+
+    if (bin.op == KOOPA_RBO_MUL && Is_element(func, vec, bin.lhs) && Is_element(func, vec, bin.rhs))
+    {
+        vec.kind = VEC_MUL;
+        vec.x = bin.lhs->kind.data.load.src;
+        vec.y = bin.rhs->kind.data.load.src;
+        return true;
+    }
+    if (Match_scaled(func, vec, value, vec.x, vec.a))
+    {
+        vec.kind = VEC_AFFINE;
+        vec.b = New_integer(0);
+        return true;
+    }
+    if (bin.op != KOOPA_RBO_ADD && bin.op != KOOPA_RBO_SUB)
+        return false;
+
+    bool sub = bin.op == KOOPA_RBO_SUB;
+    if (Is_element(func, vec, bin.lhs) && Match_scaled(func, vec, bin.rhs, vec.y, vec.a))
+    {
+        vec.kind = VEC_AXPY;
+        vec.x = bin.lhs->kind.data.load.src;
+        vec.negate_a = sub;
+        return true;
+    }
+    if (!sub && Is_element(func, vec, bin.rhs) && Match_scaled(func, vec, bin.lhs, vec.y, vec.a))
+    {
+        vec.kind = VEC_AXPY;
+        vec.x = bin.rhs->kind.data.load.src;
+        return true;
+    }
+    if (Match_scaled(func, vec, bin.lhs, vec.x, vec.a) && !Uses_var(bin.rhs, var))
+    {
+        vec.kind = VEC_AFFINE;
+        vec.b = bin.rhs;
+        vec.negate_b = sub;
+        return true;
+    }
+    if (!sub && Match_scaled(func, vec, bin.rhs, vec.x, vec.a) && !Uses_var(bin.lhs, var))
+    {
+        vec.kind = VEC_AFFINE;
+        vec.b = bin.lhs;
+        return true;
+    }
+    return false;
+}
+
+// 同一次迭代中一定相等的两个值
+static bool Same_value(koopa_raw_value_t a, koopa_raw_value_t b)
+{
+    if (a == b)
+        return true;
+    if (Is_const(a) && Is_const(b))
+        return a->kind.data.integer.value == b->kind.data.integer.value;
+    if (a->kind.tag == KOOPA_RVT_LOAD && b->kind.tag == KOOPA_RVT_LOAD)
+        return a->kind.data.load.src == b->kind.data.load.src && a->kind.data.load.src->kind.tag == KOOPA_RVT_ALLOC;
+    if (a->kind.tag != b->kind.tag || (a->kind.tag != KOOPA_RVT_BINARY && a->kind.tag != KOOPA_RVT_GET_ELEM_PTR && a->kind.tag != KOOPA_RVT_GET_PTR))
+        return false;
+    if (a->kind.tag == KOOPA_RVT_BINARY && a->kind.data.binary.op != b->kind.data.binary.op)
+        return false;
+    auto ops_a = Operands(a), ops_b = Operands(b);
+    for (size_t i = 0; i < ops_a.size(); i++)
+        if (!Same_value(*ops_a[i], *ops_b[i]))
+            return false;
+    return true;
+}
+
+// 按块处理时，读取的元素要么就是本次迭代写入的元素，要么与写入的数组完全不重叠
+static bool Independent(koopa_raw_value_t src, koopa_raw_value_t dest)
+{
+    if (Same_value(src, dest))
+        return true;
+    return Mem_base(src) != Mem_base(dest) && Alias(src, dest) == NO_ALIAS;
+}
+
+static bool Analyze_vector(Func_IR *func, Loop *loop, Vector_loop &vec)
+{
+    if (!loop->children.empty() || loop->blocks.size() != 1)
+        return false;
+    Counted_loop &info = vec.info;
+    if (!Analyze_loop(func, loop, info) || info.step != 1 || (info.op != KOOPA_RBO_LT && info.op != KOOPA_RBO_LE))
+        return false;
+    vec.loop = loop;
+    vec.x = vec.y = vec.a = vec.b = nullptr;
+    vec.negate_a = vec.negate_b = false;
+
+    vector<koopa_raw_value_t> loads;
+    if (!Scan_single_store(loop, info, vec.store, loads))
+        return false;
+    if (!Match_reduction(func, vec) && !Match_elementwise(func, vec))
+        return false;
+
+    // 除了被向量化的数组元素，其他load只能读取循环中不会被修改的内存
+    koopa_raw_value_t dest = vec.store->kind.data.store.dest;
+    for (auto load : loads)
+    {
+        koopa_raw_value_t ptr = load->kind.data.load.src;
+        if (ptr == vec.x || ptr == vec.y)
+            continue;
+        if (Uses_var(ptr, info.var))
+            return false;
+        if (Alias(ptr, dest) != NO_ALIAS && !(ptr == dest && vec.kind <= VEC_DOT))
+            return false;
+    }
+    if (vec.kind > VEC_DOT)
+    {
+        if (!Independent(vec.x, dest) || (vec.y != nullptr && !Independent(vec.y, dest)))
+            return false;
+    }
+    else
+    {
+        // 归约变量只在累加时读取一次
+        int reads = 0;
+        for (auto load : loads)
+            reads += Is_load_of(load, dest);
+        if (reads != 1)
+            return false;
+    }
+
+    int init;
+    Insert_preheader(func, loop);
+    if (Is_const(info.bound) && Find_init(loop, info.var, init))
+    {
+        long long count = (long long)info.bound->kind.data.integer.value - init + (info.op == KOOPA_RBO_LE);
+        if (count < VECTOR_MIN_TRIP)
+            return false;
+    }
+    return true;
+}
+
+static void Replace_vector(Program_IR *prog, Func_IR *func, const Vector_loop &vec)
+{
+    const Counted_loop &info = vec.info;
+    vector<koopa_raw_value_t> insts;
+
+    koopa_raw_value_t first = New_load(info.var);
+    insts.push_back(first);
+    auto rebuild = [&](koopa_raw_value_t value, bool negate) {
+        value = Rebuild_at_entry(func, vec.loop, info.var, value, first, insts);
+        if (negate)
+            insts.push_back(value = New_binary(KOOPA_RBO_SUB, New_integer(0), value));
+        return value;
+    };
+    koopa_raw_value_t dest = vec.store->kind.data.store.dest;
+    koopa_raw_value_t x = rebuild(vec.x, false);
+    koopa_raw_value_t y = vec.y == nullptr ? nullptr : rebuild(vec.y, false);
+    koopa_raw_value_t a = vec.a == nullptr ? nullptr : rebuild(vec.a, vec.negate_a);
+    koopa_raw_value_t b = vec.b == nullptr ? nullptr : rebuild(vec.b, vec.negate_b);
+    koopa_raw_value_t d = vec.kind <= VEC_DOT ? nullptr : rebuild(dest, false);
+    koopa_raw_value_t count = Emit_trip_count(info, first, insts);
+
+    const Vector_routine &routine = vector_routines[vec.kind];
+    koopa_raw_function_t callee = Routine_decl(prog, routine.name, routine.params, routine.ret_int);
+    switch (vec.kind)
+    {
+    case VEC_SUM:
+    case VEC_DOT:
+    {
+        vector<koopa_raw_value_t> args = {x};
+        if (vec.kind == VEC_DOT)
+            args.push_back(y);
+        args.push_back(count);
+        koopa_raw_value_t sum = New_call(callee, args);
+        koopa_raw_value_t old = New_load(dest);
+        koopa_raw_value_t result = New_binary(KOOPA_RBO_ADD, old, sum);
+        insts.insert(insts.end(), {sum, old, result, New_store(result, dest)});
+        break;
+    }
+    case VEC_AXPY:
+        insts.push_back(New_call(callee, {d, x, y, a, count}));
+        break;
+    case VEC_MUL:
+        insts.push_back(New_call(callee, {d, x, y, count}));
+        break;
+    case VEC_AFFINE:
+        insts.push_back(New_call(callee, {d, x, a, b, count}));
+        break;
+    }
+    Replace_loop(func, vec.loop, info, first, count, insts);
+}
+
+// RISC-V向量扩展（RVV 1.0）自动向量化，默认不打开，用-fvectorize打开
+// 对int数组求和、点积以及d[i] = x[i] ± a * y[i]这类逐元素运算的计数循环，整个循环替换为
+// 对后端例程的一次调用。例程用vsetvli分段（strip-mining）处理，每段的长度由硬件决定，
+// 最后不满一段的部分也由vsetvli处理，不需要单独的标量尾循环；不符合条件的循环保持标量代码。
+// 生成的代码需要支持V扩展的处理器（或模拟器）才能运行，运行方法见README
+void Vectorize(Program_IR *prog, Func_IR *func)
+{
+    // 例程只在RISC-V汇编中存在，输出Koopa IR时不向量化
+    if (!opt_options.riscv_target)
+        return;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        Build_CFG(func);
+        Find_loops(func);
+        for (Loop *loop : func->loops)
+        {
+            Vector_loop vec;
+            if (Analyze_vector(func, loop, vec))
+            {
+                Replace_vector(prog, func, vec);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
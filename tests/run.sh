@@ -0,0 +1,43 @@
+#!/bin/bash
+# 用法：tests/run.sh [优化选项...]，例如 tests/run.sh -fvectorize
+# 每个tests/*.sy分别用 -riscv（不优化的标量代码）和 -perf 加上给定的选项编译，
+# 在qemu的用户态模拟器上运行（打开V扩展），比较两者的标准输出和返回值。
+# 需要课程docker环境中的clang、ld.lld和libsysy（$CDE_LIBRARY_PATH/riscv32），
+# 以及qemu-riscv32-static（7.0以上才支持RVV 1.0）
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+COMPILER=${COMPILER:-$TOP/build/compiler}
+QEMU=${QEMU:-qemu-riscv32-static}
+VLEN=${VLEN:-128}
+OUT=${OUT:-$TOP/build/tests}
+mkdir -p "$OUT"
+
+# 汇编并链接运行时库
+link() {
+  clang "$1.S" -c -o "$1.o" -target riscv32-unknown-linux-elf -march=rv32im -mabi=ilp32 &&
+  ld.lld "$1.o" -L"$CDE_LIBRARY_PATH/riscv32" -lsysy -o "$1"
+}
+
+# 运行并在输出的最后记录返回值
+run() {
+  "$QEMU" -cpu rv32,v=true,vlen=$VLEN "$1" < "$2" > "$1.out" 2> /dev/null
+  echo "exit $?" >> "$1.out"
+}
+
+pass=0; fail=0
+for f in "$TOP"/tests/*.sy; do
+  b=$(basename "$f" .sy)
+  in="$TOP/tests/$b.in"; [ -f "$in" ] || in=/dev/null
+  if ! "$COMPILER" -riscv "$f" -o "$OUT/$b.ref.S" || ! link "$OUT/$b.ref" ||
+     ! "$COMPILER" -perf "$f" -o "$OUT/$b.S" "$@" || ! link "$OUT/$b"; then
+    echo "BUILD FAIL $b"; fail=$((fail + 1)); continue
+  fi
+  run "$OUT/$b.ref" "$in"
+  run "$OUT/$b" "$in"
+  if cmp -s "$OUT/$b.ref.out" "$OUT/$b.out"; then
+    echo "ok $b"; pass=$((pass + 1))
+  else
+    echo "FAIL $b"; fail=$((fail + 1))
+  fi
+done
+echo "pass $pass, fail $fail"
+[ $fail -eq 0 ]